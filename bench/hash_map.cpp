@@ -0,0 +1,90 @@
+#include "common/concurrent_hash_map.h"
+#include "common/options.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// ConcurrentHashMap against std::unordered_map behind one std::mutex, over read ratios and thread counts.
+//   --keys=K         size of the key space, prefilled (default 10000)
+//   --ops=O          operations per thread (default 200000)
+//   --threads=T      highest thread count, doubled from 1 (default 16)
+
+namespace {
+  using clock = std::chrono::steady_clock;
+
+  class LockedMap
+  {
+  public:
+    auto find(int64_t key) -> std::optional<int64_t>
+    {
+      std::unique_lock lock(mutex);
+      auto found = map.find(key);
+      if (found == map.end())
+        return std::nullopt;
+      return found->second;
+    }
+    void insert_or_assign(int64_t key, int64_t value)
+    {
+      std::unique_lock lock(mutex);
+      map.insert_or_assign(key, value);
+    }
+  private:
+    std::mutex                            mutex;
+    std::unordered_map<int64_t, int64_t>  map;
+  };
+
+  // million operations per second over `threads` threads hammering `map`
+  template<typename Map>
+  auto run(Map& map, int threads, long keys, long ops, double read_ratio) -> double
+  {
+    for (long key = 0; key < keys; ++key)
+      map.insert_or_assign(key, key);
+
+    std::vector<std::thread> workers;
+    const clock::time_point begin = clock::now();
+    for (int thread = 0; thread < threads; ++thread) {
+      workers.emplace_back([&map, thread, keys, ops, read_ratio] {
+        std::mt19937_64 gen(thread);
+        std::uniform_int_distribution<long> key(0, keys - 1);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        int64_t sink = 0;
+        for (long op = 0; op < ops; ++op) {
+          if (coin(gen) < read_ratio)
+            sink += map.find(key(gen)).value_or(0);
+          else
+            map.insert_or_assign(key(gen), op);
+        }
+        volatile int64_t keep = sink;
+        (void)keep;
+      });
+    }
+    for (std::thread& worker : workers)
+      worker.join();
+    const double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    return threads * ops / seconds / 1e6;
+  }
+}
+
+
+int main(int argc, const char** argv)
+{
+  Options options(argc, argv);
+  const long keys = options.get_int("keys", 10000);
+  const long ops = options.get_int("ops", 200000);
+  const long max_threads = options.get_int("threads", 16);
+
+  std::printf("%8s %8s %16s %16s %8s\n", "reads", "threads", "mutex Mops/s", "sharded Mops/s", "speedup");
+  for (double read_ratio : { 0.5, 0.9, 0.99 }) {
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+      LockedMap locked;
+      ConcurrentHashMap<int64_t, int64_t> sharded(keys);
+      const double baseline = run(locked, threads, keys, ops, read_ratio);
+      const double candidate = run(sharded, threads, keys, ops, read_ratio);
+      std::printf("%7.0f%% %8d %16.2f %16.2f %7.2fx\n", read_ratio * 100, threads, baseline, candidate, candidate / baseline);
+    }
+  }
+}
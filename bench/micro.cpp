@@ -0,0 +1,119 @@
+#include "common/encoding/base64.h"
+#include "common/message.h"
+#include "common/options.h"
+#include "common/snowflake.h"
+#include "ext/nlohmann/json.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+
+// per-message hot path costs in isolation: ns/op and heap allocations/op of parsing, serializing,
+// type lookup, id generation and base64url.
+//   --seconds=S      minimum measuring time per benchmark (default 0.5)
+//   --filter=TEXT    only benchmarks whose name contains TEXT
+
+namespace {
+  // counted by the replaced global operator new below
+  std::atomic<uint64_t> allocations = 0;
+
+  template<typename T>
+  void keep(T&& value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  struct Runner {
+    double            seconds;
+    std::string_view  filter;
+
+    template<typename Fn>
+    void run(const char* name, Fn&& fn) const
+    {
+      if (!filter.empty() && std::string_view(name).find(filter) == std::string_view::npos)
+        return;
+      using clock = std::chrono::steady_clock;
+      // warm up and grow the batch until a single one takes long enough to time reliably
+      uint64_t batch = 1;
+      for (;;) {
+        const clock::time_point started = clock::now();
+        for (uint64_t idx = 0; idx < batch; ++idx)
+          fn();
+        if (clock::now() - started > std::chrono::milliseconds(10) || batch >= uint64_t(1) << 30)
+          break;
+        batch *= 2;
+      }
+      uint64_t iterations = 0;
+      const uint64_t allocated = allocations.load(std::memory_order_relaxed);
+      const clock::time_point started = clock::now();
+      clock::duration elapsed{};
+      do {
+        for (uint64_t idx = 0; idx < batch; ++idx)
+          fn();
+        iterations += batch;
+        elapsed = clock::now() - started;
+      } while (elapsed < std::chrono::duration<double>(seconds));
+      const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+      std::printf("%-32s %12.1f %12.2f %14lu\n", name, ns / iterations,
+        static_cast<double>(allocations.load(std::memory_order_relaxed) - allocated) / iterations,
+        static_cast<unsigned long>(iterations));
+    }
+  };
+}
+
+
+auto operator new(std::size_t size) -> void*
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    return ptr;
+  std::abort();
+}
+
+auto operator new[](std::size_t size) -> void*
+{
+  return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept                    { std::free(ptr); }
+void operator delete[](void* ptr) noexcept                  { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept       { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept     { std::free(ptr); }
+
+
+int main(int argc, const char** argv)
+{
+  using json = nlohmann::json;
+  Options options(argc, argv);
+  const Runner runner{ options.get_double("seconds", 0.5), options.get("filter").value_or("") };
+
+  const std::string echo = R"({"src":"c1","dest":"n1","body":{"type":"echo","msg_id":1,"echo":"Please echo 35"}})";
+  const std::string txn = R"({"src":"c1","dest":"n1","body":{"type":"txn","msg_id":7,"txn":[["r",1,null],["w",2,3],["r",4,null]]}})";
+  const json echo_json = json::parse(echo);
+  const Message echo_message = Message::parse(echo).value();
+  const Message echo_response = echo_message.create_response();
+  const Snowflake id = Snowflake::generate();
+  const Snowflake id_64 = Snowflake::generate_64();
+  const json id_json = id.as_json();
+  const json id_64_json = id_64.as_json();
+  const std::string payload(64, 'x');
+
+  std::printf("%-32s %12s %12s %14s\n", "benchmark", "ns/op", "allocs/op", "iterations");
+  runner.run("Message::parse echo",             [&] { keep(Message::parse(echo)); });
+  runner.run("Message::parse txn",              [&] { keep(Message::parse(txn)); });
+  runner.run("Message::from_json echo",         [&] { keep(Message::from_json(echo_json)); });
+  runner.run("Message::as_json echo_ok",        [&] { keep(echo_response.as_json()); });
+  runner.run("Message::as_json + dump",         [&] { keep(echo_response.as_json().dump()); });
+  runner.run("Message::create_response",        [&] { keep(echo_message.create_response()); });
+  runner.run("message_type_from_string",        [&] { keep(message_type_from_string("list_committed_offsets")); });
+  runner.run("Snowflake::generate",             [&] { keep(Snowflake::generate()); });
+  runner.run("Snowflake::generate_64",          [&] { keep(Snowflake::generate_64()); });
+  runner.run("Snowflake::as_json",              [&] { keep(id.as_json()); });
+  runner.run("Snowflake::as_json 64",           [&] { keep(id_64.as_json()); });
+  runner.run("Snowflake::from_json",            [&] { keep(Snowflake::from_json(id_json)); });
+  runner.run("Snowflake::from_json 64",         [&] { keep(Snowflake::from_json(id_64_json)); });
+  runner.run("encoding::encode_base64url 64B",  [&] { keep(encoding::encode_base64url(payload)); });
+}
@@ -0,0 +1,268 @@
+#include "common/options.h"
+#include "ext/nlohmann/json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// end-to-end throughput of bin/node.run: replays a generated maelstrom stream through its stdin/stdout.
+// message shapes come from the requests in test/sample-*.txt, re-addressed and re-numbered, echo payloads
+// get random sizes. at most `window` messages are in flight, round trips are measured per message.
+// results are compared against a baseline file, `make bench` runs it against bench/replay.baseline.
+//   --node=PATH          node binary (default ./bin/node.run)
+//   --node-arg=ARG       one argument passed on to the node, e.g. --node-arg=--io=uring
+//   --samples=DIR        directory of sample-*.txt request templates (default ./test)
+//   --messages=N         messages after init (default 1000000)
+//   --window=W           messages in flight (default 256)
+//   --txn=F              fraction of txn-rw-register messages mixed in (default 0)
+//   --seed=S             generator seed (default 1)
+//   --baseline=FILE      compares against FILE if it exists
+//   --update-baseline    writes the results to FILE instead
+
+namespace {
+  using json = nlohmann::json;
+  using clock = std::chrono::steady_clock;
+
+  struct Child {
+    pid_t pid = -1;
+    int   in  = -1;
+    FILE* out = nullptr;
+  };
+
+  auto spawn(const std::string& binary, const std::optional<std::string>& arg) -> Child
+  {
+    int to_child[2], from_child[2];
+    if (::pipe(to_child) != 0 || ::pipe(from_child) != 0) {
+      std::perror("pipe");
+      std::exit(1);
+    }
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+      ::dup2(to_child[0], STDIN_FILENO);
+      ::dup2(from_child[1], STDOUT_FILENO);
+      // the node logs every message, that stays part of what is measured but not of what is shown
+      const int null = ::open("/dev/null", O_WRONLY);
+      ::dup2(null, STDERR_FILENO);
+      ::close(to_child[0]); ::close(to_child[1]); ::close(from_child[0]); ::close(from_child[1]);
+      if (arg.has_value())
+        ::execl(binary.c_str(), binary.c_str(), arg->c_str(), static_cast<char*>(nullptr));
+      else
+        ::execl(binary.c_str(), binary.c_str(), static_cast<char*>(nullptr));
+      std::_Exit(127);
+    }
+    ::close(to_child[0]);
+    ::close(from_child[1]);
+    return { pid, to_child[1], ::fdopen(from_child[0], "r") };
+  }
+
+  void write_all(int fd, std::string_view bytes)
+  {
+    while (!bytes.empty()) {
+      const ssize_t put = ::write(fd, bytes.data(), bytes.size());
+      if (put < 0 && errno == EINTR)
+        continue;
+      if (put <= 0) {
+        std::perror("write to node");
+        std::exit(1);
+      }
+      bytes.remove_prefix(put);
+    }
+  }
+
+  auto reply_id(std::string_view line) -> std::optional<uint64_t>
+  {
+    constexpr std::string_view field = "\"in_reply_to\":";
+    const std::size_t at = line.find(field);
+    if (at == std::string_view::npos)
+      return std::nullopt;
+    return std::strtoull(line.data() + at + field.size(), nullptr, 10);
+  }
+
+  // the request bodies of every sample file, init separately
+  auto load_samples(const std::string& directory, json& init) -> std::vector<json>
+  {
+    std::vector<json> templates;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+      const std::string name = entry.path().filename().string();
+      if (!name.starts_with("sample-") || !name.ends_with(".txt"))
+        continue;
+      std::ifstream file(entry.path());
+      for (std::string line; std::getline(file, line);) {
+        json parsed = json::parse(line, nullptr, false);
+        if (parsed.is_discarded() || !parsed.contains("body") || !parsed["body"].contains("type"))
+          continue;
+        if (parsed["body"]["type"] == "init")
+          init = parsed["body"];
+        else
+          templates.push_back(parsed["body"]);
+      }
+    }
+    return templates;
+  }
+
+  auto read_baseline(const std::string& path) -> std::map<std::string, double>
+  {
+    std::map<std::string, double> values;
+    std::ifstream file(path);
+    std::string key;
+    double value;
+    while (file >> key >> value)
+      values[key] = value;
+    return values;
+  }
+}
+
+
+int main(int argc, const char** argv)
+{
+  Options options(argc, argv);
+  const std::string binary(options.get("node").value_or("./bin/node.run"));
+  const std::string samples(options.get("samples").value_or("./test"));
+  const uint64_t messages = options.get_int("messages", 1000000);
+  const uint64_t window = std::max(1L, options.get_int("window", 256));
+  const double txn_share = options.get_double("txn", 0.0);
+  const std::string baseline(options.get("baseline").value_or(""));
+
+  json init = { { "type", "init" }, { "node_id", "n1" }, { "node_ids", { "n1" } } };
+  std::vector<json> templates = load_samples(samples, init);
+  if (templates.empty()) {
+    std::fprintf(stderr, "no request templates found in '%s'\n", samples.c_str());
+    return 1;
+  }
+  const std::string node_id = init.value("node_id", "n1");
+  init["msg_id"] = 1;
+
+  std::optional<std::string> node_arg;
+  if (options.has("node-arg"))
+    node_arg = std::string(options.get("node-arg").value());
+  Child child = spawn(binary, node_arg);
+  write_all(child.in, json({ { "src", "c1" }, { "dest", node_id }, { "body", init } }).dump() + "\n");
+  char* buffer = nullptr;
+  std::size_t capacity = 0;
+  if (::getline(&buffer, &capacity, child.out) <= 0) {
+    std::fprintf(stderr, "node exited before answering init\n");
+    return 1;
+  }
+
+  std::vector<clock::time_point> sent(messages);
+  std::vector<uint64_t> round_trips(messages);
+  std::mutex mutex_window;
+  std::condition_variable window_condition;
+  uint64_t answered = 0;
+
+  const clock::time_point started = clock::now();
+  std::thread writer([&] {
+    std::mt19937_64 gen(options.get_int("seed", 1));
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<int> payload(8, 256);
+    std::uniform_int_distribution<int> key(0, 63);
+    std::uniform_int_distribution<std::size_t> pick(0, templates.size() - 1);
+    std::string batch;
+    for (uint64_t idx = 0; idx < messages; ++idx) {
+      if (idx >= window) {
+        std::unique_lock lock(mutex_window);
+        if (answered + window <= idx) {
+          // everything buffered has to be out before waiting on its replies
+          lock.unlock();
+          write_all(child.in, batch);
+          batch.clear();
+          lock.lock();
+          window_condition.wait(lock, [&] { return answered + window > idx; });
+        }
+      }
+      json body;
+      if (coin(gen) < txn_share) {
+        body = { { "type", "txn" }, { "txn", { { "r", key(gen), nullptr }, { "w", key(gen), idx } } } };
+      } else {
+        body = templates[pick(gen)];
+        if (body["type"] == "echo")
+          body["echo"] = std::string(payload(gen), 'x');
+      }
+      body["msg_id"] = idx + 2;
+      sent[idx] = clock::now();
+      batch += json({ { "src", "c1" }, { "dest", node_id }, { "body", std::move(body) } }).dump();
+      batch += '\n';
+      // small batches, a message waiting in here inflates its round trip
+      if (idx % 32 == 31) {
+        write_all(child.in, batch);
+        batch.clear();
+      }
+    }
+    write_all(child.in, batch);
+  });
+
+  uint64_t received = 0;
+  while (received < messages) {
+    const ssize_t length = ::getline(&buffer, &capacity, child.out);
+    if (length <= 0) {
+      std::fprintf(stderr, "node closed its output after %lu replies\n", static_cast<unsigned long>(received));
+      return 1;
+    }
+    const std::optional<uint64_t> id = reply_id(std::string_view(buffer, length));
+    if (!id.has_value() || id.value() < 2 || id.value() - 2 >= messages)
+      continue;
+    round_trips[received++] = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - sent[id.value() - 2]).count();
+    std::unique_lock lock(mutex_window);
+    ++answered;
+    window_condition.notify_one();
+  }
+  const double seconds = std::chrono::duration<double>(clock::now() - started).count();
+  writer.join();
+
+  write_all(child.in, "\n");
+  ::close(child.in);
+  int status = 0;
+  struct rusage usage{};
+  ::wait4(child.pid, &status, 0, &usage);
+  std::free(buffer);
+
+  std::sort(round_trips.begin(), round_trips.end());
+  const auto percentile = [&](double quantile) {
+    return round_trips[std::min<std::size_t>(round_trips.size() - 1, quantile * round_trips.size())] / 1e3;
+  };
+  const std::map<std::string, double> results = {
+    { "msgs_per_sec", messages / seconds },
+    { "p50_us",       percentile(0.5) },
+    { "p99_us",       percentile(0.99) },
+    { "p999_us",      percentile(0.999) },
+    { "peak_rss_kb",  static_cast<double>(usage.ru_maxrss) },
+  };
+
+  const std::map<std::string, double> previous = baseline.empty() ? std::map<std::string, double>() : read_baseline(baseline);
+  std::printf("%lu messages in %.2fs, window %lu\n", static_cast<unsigned long>(messages), seconds, static_cast<unsigned long>(window));
+  std::printf("%-14s %14s %14s %9s\n", "metric", "result", "baseline", "change");
+  for (const auto& [name, value] : results) {
+    auto found = previous.find(name);
+    if (found == previous.end() || found->second == 0) {
+      std::printf("%-14s %14.1f %14s %9s\n", name.c_str(), value, "-", "-");
+      continue;
+    }
+    std::printf("%-14s %14.1f %14.1f %+8.1f%%\n", name.c_str(), value, found->second, 100.0 * (value - found->second) / found->second);
+  }
+
+  if (options.has("update-baseline") && !baseline.empty()) {
+    std::ofstream file(baseline, std::ios::trunc);
+    for (const auto& [name, value] : results)
+      file << name << ' ' << value << '\n';
+    std::printf("baseline written to '%s'\n", baseline.c_str());
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "common/node.h"
+#include "common/options.h"
+#include "raft/raft.h"
+#include "sim/simulator.h"
+#include "txn/txn.h"
+#include "ext/nlohmann/json.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+
+// multi-node runs on the deterministic simulator, without maelstrom. closed-loop clients each keep one
+// request in flight against a random node, the report shows message counts and per-request latency in virtual time.
+//   --workload=W         raft (lin-kv read/write/cas), txn (txn-rw-register) or echo (default raft)
+//   --nodes=N            cluster size (default 3)
+//   --clients=C          concurrent clients (default 8)
+//   --seconds=S          virtual duration (default 10)
+//   --seed=S             seed for the network, the nodes and the clients (default 1)
+//   --latency-us=U       mean one-way latency (default 1000)
+//   --latency-min-us=U   minimum one-way latency (default 100)
+//   --distribution=D     fixed, uniform or exponential (default exponential)
+//   --drop=F             fraction of messages lost (default 0)
+//   --keys=K             key space of raft and txn requests (default 16)
+//   --partition-at=S     cuts the first node off from the rest at S virtual seconds
+//   --heal-at=S          heals the partition at S virtual seconds
+//   --verbose            keeps the nodes' logging
+
+namespace {
+  using json = nlohmann::json;
+
+  auto build_request(const std::string& workload, Simulator& sim, long keys) -> json
+  {
+    const long key = static_cast<long>(sim.random() % keys);
+    const long value = static_cast<long>(sim.random() % 1000);
+    if (workload == "echo")
+      return { { "type", "echo" }, { "echo", "ping" } };
+    if (workload == "txn") {
+      return { { "type", "txn" }, { "txn", {
+        { "r", key, nullptr }, { "w", (key + 1) % keys, value }, { "r", (key + 2) % keys, nullptr } } } };
+    }
+    switch (sim.random() % 3) {
+      case 0:   return { { "type", "read" }, { "key", key } };
+      case 1:   return { { "type", "write" }, { "key", key }, { "value", value } };
+      default:  return { { "type", "cas" }, { "key", key }, { "from", value }, { "to", value + 1 } };
+    }
+  }
+
+  // one request in flight per client, the next goes out as soon as the previous is answered or timed out
+  void client_loop(Simulator& sim, const std::string& workload, std::string client, long keys)
+  {
+    const std::string& target = sim.node_ids()[sim.random() % sim.node_ids().size()];
+    sim.request(client, target, build_request(workload, sim, keys), [&sim, &workload, client, keys](const std::optional<Message>&) {
+      client_loop(sim, workload, client, keys);
+    });
+  }
+}
+
+
+int main(int argc, const char** argv)
+{
+  Options options(argc, argv);
+  if (!options.has("verbose"))
+    std::clog.rdbuf(nullptr);
+  const std::string workload(options.get("workload").value_or("raft"));
+  const long clients = options.get_int("clients", 8);
+  const long keys = std::max(1L, options.get_int("keys", 16));
+  const double seconds = options.get_double("seconds", 10.0);
+
+  Simulator::Config config;
+  config.nodes = options.get_int("nodes", config.nodes);
+  config.seed = options.get_int("seed", config.seed);
+  config.latency_mean = std::chrono::microseconds(options.get_int("latency-us", config.latency_mean.count()));
+  config.latency_min = std::chrono::microseconds(options.get_int("latency-min-us", config.latency_min.count()));
+  config.drop_rate = options.get_double("drop", config.drop_rate);
+  const std::string distribution(options.get("distribution").value_or("exponential"));
+  config.distribution = distribution == "fixed" ? Simulator::FIXED
+    : distribution == "uniform" ? Simulator::UNIFORM
+    : Simulator::EXPONENTIAL;
+
+  Simulator sim(config, [&workload](Node& node) -> std::shared_ptr<void> {
+    node.register_handler(ECHO_REQ, [](const Message& msg) -> Message {
+      Message response = msg.create_response();
+      response.body["echo"] = msg.body["echo"];
+      return response;
+    });
+    if (workload == "txn")
+      return std::make_shared<Txn>(node);
+    Raft::Config raft_config;
+    // snapshots are taken on a background thread, which would put the schedule at the mercy of the os
+    raft_config.snapshot_threshold = std::numeric_limits<int64_t>::max();
+    return std::make_shared<Raft>(node, raft_config);
+  });
+
+  for (long client = 0; client < clients; ++client)
+    client_loop(sim, workload, std::string("c").append(std::to_string(client + 1)), keys);
+  if (options.has("partition-at")) {
+    sim.after(std::chrono::microseconds(static_cast<int64_t>(options.get_double("partition-at", 0.0) * 1e6)), [&sim] {
+      std::vector<std::string> rest(sim.node_ids().begin() + 1, sim.node_ids().end());
+      sim.partition({ { sim.node_ids().front() }, rest });
+    });
+  }
+  if (options.has("heal-at"))
+    sim.after(std::chrono::microseconds(static_cast<int64_t>(options.get_double("heal-at", 0.0) * 1e6)), [&sim] { sim.heal(); });
+
+  const auto started = std::chrono::steady_clock::now();
+  sim.run_for(std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6)));
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  std::printf("%s on %zu nodes, %ld clients, %.1fs virtual in %.2fs wall, seed %lu\n\n", workload.c_str(), config.nodes,
+    clients, seconds, wall, static_cast<unsigned long>(config.seed));
+  sim.report(std::cout);
+}
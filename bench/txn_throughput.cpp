@@ -0,0 +1,93 @@
+#include "common/node.h"
+#include "common/options.h"
+#include "txn/txn.h"
+#include "ext/nlohmann/json.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+// txn-rw-register throughput of the mvcc store over concurrent workers, once per isolation level.
+//   --workers=N      concurrent workers (default: hardware threads)
+//   --seconds=S      duration per isolation level (default 2)
+//   --keys=K         size of the key space (default 1000)
+//   --ops=O          micro-ops per transaction (default 4)
+//   --read-only=F    fraction of read-only transactions (default 0.5)
+//   --attempts=A     attempts before a transaction counts as aborted (default 1)
+
+namespace {
+  using json = nlohmann::json;
+  using clock = std::chrono::steady_clock;
+
+  struct Result {
+    uint64_t committed  = 0;
+    uint64_t aborted    = 0;
+    uint64_t reads      = 0;
+  };
+
+  auto run(const Options& options, MVCCStore::Isolation isolation) -> Result
+  {
+    const long workers = options.get_int("workers", std::max(1u, std::thread::hardware_concurrency()));
+    const double seconds = options.get_double("seconds", 2.0);
+    const long keys = options.get_int("keys", 1000);
+    const long ops = options.get_int("ops", 4);
+    const double read_only = options.get_double("read-only", 0.5);
+
+    Node node(1);
+    Txn txn(node, { isolation, static_cast<int>(options.get_int("attempts", 1)) });
+
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> committed = 0, aborted = 0, reads = 0;
+    std::vector<std::thread> threads;
+    for (long worker = 0; worker < workers; ++worker) {
+      threads.emplace_back([&, worker] {
+        std::mt19937_64 gen(worker);
+        std::uniform_int_distribution<long> key(0, keys - 1);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        uint64_t local_committed = 0, local_aborted = 0, local_reads = 0;
+        int64_t value = worker << 32;
+        while (!stop.load(std::memory_order_relaxed)) {
+          const bool writes = coin(gen) >= read_only;
+          json ops_json = json::array();
+          for (long op = 0; op < ops; ++op) {
+            if (writes && op % 2 == 1)
+              ops_json.push_back(json::array({ "w", key(gen), ++value }));
+            else
+              ops_json.push_back(json::array({ "r", key(gen), nullptr }));
+          }
+          if (txn.execute(ops_json).has_value()) {
+            ++local_committed;
+            local_reads += !writes;
+          } else {
+            ++local_aborted;
+          }
+        }
+        committed += local_committed;
+        aborted += local_aborted;
+        reads += local_reads;
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (std::thread& thread : threads)
+      thread.join();
+    return { committed.load(), aborted.load(), reads.load() };
+  }
+}
+
+
+int main(int argc, const char** argv)
+{
+  Options options(argc, argv);
+  const double seconds = options.get_double("seconds", 2.0);
+  std::printf("%-16s %14s %14s %14s %10s\n", "isolation", "txn/s", "read-only/s", "aborted/s", "abort %");
+  for (auto [name, isolation] : { std::pair{ "read-committed", MVCCStore::READ_COMMITTED }, std::pair{ "snapshot", MVCCStore::SNAPSHOT } }) {
+    const Result result = run(options, isolation);
+    const double total = static_cast<double>(result.committed + result.aborted);
+    std::printf("%-16s %14.0f %14.0f %14.0f %9.2f%%\n", name,
+      result.committed / seconds, result.reads / seconds, result.aborted / seconds,
+      total > 0 ? 100.0 * result.aborted / total : 0.0);
+  }
+}
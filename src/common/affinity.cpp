@@ -0,0 +1,86 @@
+#include "affinity.h"
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+auto Affinity::allowed_cpus() -> std::vector<int>
+{
+  std::vector<int> cpus;
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed))
+        cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty())
+    cpus.push_back(0);
+  return cpus;
+}
+
+
+auto Affinity::parse_cpu_list(std::string_view list) -> std::optional<std::vector<int>>
+{
+  const auto number = [](std::string_view text) -> std::optional<int> {
+    int out = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    if (ec != std::errc() || end != text.data() + text.size() || out < 0 || out >= CPU_SETSIZE)
+      return std::nullopt;
+    return out;
+  };
+  std::vector<int> cpus;
+  while (!list.empty()) {
+    const std::size_t comma = list.find(',');
+    const std::string_view range = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    const std::size_t dash = range.find('-');
+    const std::optional<int> first = number(range.substr(0, dash));
+    const std::optional<int> last = dash == std::string_view::npos ? first : number(range.substr(dash + 1));
+    if (!first.has_value() || !last.has_value() || last.value() < first.value())
+      return std::nullopt;
+    for (int cpu = first.value(); cpu <= last.value(); ++cpu)
+      cpus.push_back(cpu);
+  }
+  if (cpus.empty())
+    return std::nullopt;
+  return cpus;
+}
+
+
+auto Affinity::pin(int cpu) -> bool
+{
+  cpu_set_t pinned;
+  CPU_ZERO(&pinned);
+  CPU_SET(cpu, &pinned);
+  if (const int err = pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned); err != 0) {
+    std::clog << "[⚠️][SYS] cannot pin thread to cpu " << cpu << ": " << std::strerror(err) << '\n';
+    return false;
+  }
+  // overrides whatever policy was inherited, e.g. numactl --interleave: pages come from the node running the thread
+  if (::syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0)
+    std::clog << "[⚠️][SYS] cannot prefer local memory on cpu " << cpu << ": " << std::strerror(errno) << '\n';
+  return true;
+}
+
+
+auto Affinity::numa_node_of(int cpu) -> int
+{
+  std::error_code error;
+  const std::filesystem::path dir("/sys/devices/system/cpu/cpu" + std::to_string(cpu));
+  for (std::filesystem::directory_iterator entry(dir, error), end; !error && entry != end; entry.increment(error)) {
+    const std::string name = entry->path().filename().string();
+    int node = -1;
+    if (name.starts_with("node") && std::from_chars(name.data() + 4, name.data() + name.size(), node).ec == std::errc())
+      return node;
+  }
+  return -1;
+}
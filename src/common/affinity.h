@@ -0,0 +1,22 @@
+#ifndef COMMON_AFFINITY_HEADER
+#define COMMON_AFFINITY_HEADER
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// thread placement without libnuma: which cpus the process may run on, pinning the calling thread to one of them
+// and which numa node a cpu sits on, as reported by sysfs
+class Affinity
+{
+public:
+  // in ascending order, never empty
+  static auto allowed_cpus() -> std::vector<int>;
+  // "0-3,8,10-11" as taken by taskset and found in sysfs, nullopt if malformed
+  static auto parse_cpu_list(std::string_view list) -> std::optional<std::vector<int>>;
+  // pins the calling thread to `cpu` and has its allocations from then on come from that cpu's numa node
+  static auto pin(int cpu) -> bool;
+  // -1 without a numa topology
+  static auto numa_node_of(int cpu) -> int;
+};
+
+#endif
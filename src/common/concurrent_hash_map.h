@@ -0,0 +1,246 @@
+#ifndef COMMON_CONCURRENT_HASH_MAP_HEADER
+#define COMMON_CONCURRENT_HASH_MAP_HEADER
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+// hash map shared by all workers: `shard_count` independent open-addressing tables (linear probing,
+// tombstones, cached hashes), each behind its own reader-writer lock on its own cache line.
+// lookups only take their shard's shared lock, so readers never serialize against each other and
+// writers only against the 1/`shard_count` of keys that share their shard.
+// values are handed out by copy or visited under the lock, never by reference that outlives it.
+template<typename Key, typename Value, typename Hash = std::hash<Key>, std::size_t shard_count = 64>
+class ConcurrentHashMap
+{
+  static_assert(std::has_single_bit(shard_count), "shard_count must be a power of two");
+public:
+  explicit ConcurrentHashMap(std::size_t capacity = 0)
+  {
+    const std::size_t per_shard = std::bit_ceil(std::max(min_capacity, capacity / shard_count * 2));
+    for (Shard& shard : shards)
+      shard.slots.resize(per_shard);
+  }
+
+  auto find(const Key& key) const -> std::optional<Value>
+  {
+    const uint64_t hash = hash_of(key);
+    const Shard& shard = shard_of(hash);
+    std::shared_lock lock(shard.mutex);
+    const std::size_t idx = shard.locate(key, hash);
+    if (idx == npos)
+      return std::nullopt;
+    return shard.slots[idx].value;
+  }
+
+  // calls `fn(const Value&)` under the shard's shared lock, false if the key is absent
+  template<typename Fn>
+  auto visit(const Key& key, Fn&& fn) const -> bool
+  {
+    const uint64_t hash = hash_of(key);
+    const Shard& shard = shard_of(hash);
+    std::shared_lock lock(shard.mutex);
+    const std::size_t idx = shard.locate(key, hash);
+    if (idx == npos)
+      return false;
+    fn(shard.slots[idx].value);
+    return true;
+  }
+
+  auto contains(const Key& key) const -> bool
+  {
+    return visit(key, [](const Value&) {});
+  }
+
+  // false and `value` dropped if the key is already present
+  auto insert(const Key& key, Value value) -> bool
+  {
+    const uint64_t hash = hash_of(key);
+    Shard& shard = shard_of(hash);
+    std::unique_lock lock(shard.mutex);
+    auto [slot, inserted] = shard.claim(key, hash);
+    if (inserted)
+      slot.value = std::move(value);
+    return inserted;
+  }
+
+  void insert_or_assign(const Key& key, Value value)
+  {
+    const uint64_t hash = hash_of(key);
+    Shard& shard = shard_of(hash);
+    std::unique_lock lock(shard.mutex);
+    shard.claim(key, hash).first.value = std::move(value);
+  }
+
+  // calls `fn(Value&)` under the shard's exclusive lock, on a default constructed value if the key is new
+  template<typename Fn>
+  void upsert(const Key& key, Fn&& fn)
+  {
+    const uint64_t hash = hash_of(key);
+    Shard& shard = shard_of(hash);
+    std::unique_lock lock(shard.mutex);
+    fn(shard.claim(key, hash).first.value);
+  }
+
+  // removes the key and hands its value to the caller
+  auto take(const Key& key) -> std::optional<Value>
+  {
+    const uint64_t hash = hash_of(key);
+    Shard& shard = shard_of(hash);
+    std::unique_lock lock(shard.mutex);
+    const std::size_t idx = shard.locate(key, hash);
+    if (idx == npos)
+      return std::nullopt;
+    std::optional<Value> out(std::move(shard.slots[idx].value));
+    shard.release(idx);
+    return out;
+  }
+
+  auto erase(const Key& key) -> bool
+  {
+    return take(key).has_value();
+  }
+
+  // not a snapshot, shards are summed one after another
+  auto size() const -> std::size_t
+  {
+    std::size_t total = 0;
+    for (const Shard& shard : shards) {
+      std::shared_lock lock(shard.mutex);
+      total += shard.live;
+    }
+    return total;
+  }
+
+  // calls `fn(const Key&, const Value&)` for every entry, one shard at a time under its shared lock
+  template<typename Fn>
+  void for_each(Fn&& fn) const
+  {
+    for (const Shard& shard : shards) {
+      std::shared_lock lock(shard.mutex);
+      for (const Slot& slot : shard.slots) {
+        if (slot.state == FULL)
+          fn(slot.key, slot.value);
+      }
+    }
+  }
+
+private:
+  static constexpr std::size_t min_capacity = 16;
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+  static constexpr int shard_bits = std::countr_zero(shard_count);
+
+  enum State : uint8_t {
+    EMPTY,
+    FULL,
+    DELETED,
+  };
+  struct Slot {
+    uint64_t  hash  = 0;
+    State     state = EMPTY;
+    Key       key{};
+    Value     value{};
+  };
+
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    std::vector<Slot>         slots;
+    std::size_t               live = 0;
+    // live entries plus tombstones, bounds the probe length
+    std::size_t               used = 0;
+
+    auto locate(const Key& key, uint64_t hash) const -> std::size_t
+    {
+      const std::size_t mask = slots.size() - 1;
+      for (std::size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+        const Slot& slot = slots[idx];
+        if (slot.state == EMPTY)
+          return npos;
+        if (slot.state == FULL && slot.hash == hash && slot.key == key)
+          return idx;
+      }
+    }
+
+    // the slot holding `key`, claimed for it if absent. true if it was claimed
+    auto claim(const Key& key, uint64_t hash) -> std::pair<Slot&, bool>
+    {
+      if (const std::size_t idx = locate(key, hash); idx != npos)
+        return { slots[idx], false };
+      // past 3/4 occupancy, grow when live entries alone fill half, otherwise just sweep the tombstones
+      if ((used + 1) * 4 > slots.size() * 3)
+        rehash((live + 1) * 2 > slots.size() ? slots.size() * 2 : slots.size());
+
+      const std::size_t mask = slots.size() - 1;
+      std::size_t idx = hash & mask;
+      while (slots[idx].state == FULL)
+        idx = (idx + 1) & mask;
+      Slot& slot = slots[idx];
+      if (slot.state == EMPTY)
+        ++used;
+      ++live;
+      slot.hash = hash;
+      slot.state = FULL;
+      slot.key = key;
+      return { slot, true };
+    }
+
+    void release(std::size_t idx)
+    {
+      Slot& slot = slots[idx];
+      slot.state = DELETED;
+      slot.key = Key{};
+      slot.value = Value{};
+      --live;
+    }
+
+    void rehash(std::size_t capacity)
+    {
+      std::vector<Slot> old(capacity);
+      old.swap(slots);
+      const std::size_t mask = slots.size() - 1;
+      for (Slot& slot : old) {
+        if (slot.state != FULL)
+          continue;
+        std::size_t idx = slot.hash & mask;
+        while (slots[idx].state != EMPTY)
+          idx = (idx + 1) & mask;
+        slots[idx] = std::move(slot);
+      }
+      used = live;
+    }
+  };
+
+  static auto hash_of(const Key& key) -> uint64_t
+  {
+    // std::hash is the identity for integers, mix so neighbouring keys spread over shards and slots
+    uint64_t hash = Hash()(key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  auto shard_of(uint64_t hash) -> Shard&              { return shards[shard_index(hash)]; }
+  auto shard_of(uint64_t hash) const -> const Shard&  { return shards[shard_index(hash)]; }
+  static auto shard_index(uint64_t hash) -> std::size_t
+  {
+    // the top bits pick the shard, the bottom bits the slot inside it
+    if constexpr (shard_bits == 0)
+      return 0;
+    else
+      return hash >> (64 - shard_bits);
+  }
+
+  std::array<Shard, shard_count> shards;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include "crc32.h"
+#include <array>
+
+namespace encoding {
+  auto crc32(std::string_view data) -> uint32_t
+  {
+    static const std::array<uint32_t, 256> table = [] {
+      std::array<uint32_t, 256> out{};
+      for (uint32_t idx = 0; idx < out.size(); ++idx) {
+        uint32_t crc = idx;
+        for (int bit = 0; bit < 8; ++bit)
+          crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320u : crc >> 1;
+        out[idx] = crc;
+      }
+      return out;
+    }();
+    uint32_t crc = 0xffffffffu;
+    for (const char c : data)
+      crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+  }
+}
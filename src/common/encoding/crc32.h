@@ -0,0 +1,11 @@
+#ifndef COMMON_ENCODING_CRC32_HEADER
+#define COMMON_ENCODING_CRC32_HEADER
+#include <cstdint>
+#include <string_view>
+
+namespace encoding {
+  // ieee 802.3 crc32, as used by zlib
+  auto crc32(std::string_view data) -> uint32_t;
+}
+
+#endif
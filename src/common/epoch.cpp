@@ -0,0 +1,188 @@
+#include "epoch.h"
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+
+namespace {
+  struct alignas(64) Record {
+    std::atomic<bool>     claimed = false;
+    std::atomic<bool>     online  = false;
+    std::atomic<uint64_t> epoch   = 0;
+  };
+
+  struct Retired {
+    void*     ptr;
+    void      (*deleter)(void*);
+    uint64_t  epoch;
+  };
+
+  // a thread's limbo list is swept on retire once it holds this many entries, besides every quiescent point
+  constexpr std::size_t collect_threshold = 64;
+
+  std::atomic<uint64_t>                   global_epoch = 0;
+  std::array<Record, Epoch::max_threads>  records;
+  // one past the highest record ever claimed, bounds the scan on every quiescent point
+  std::atomic<std::size_t>                records_used = 0;
+  std::atomic<std::size_t>                pending_count = 0;
+
+  // limbo lists left behind by threads that exited before everything they retired could be freed
+  std::mutex                              mutex_orphans;
+  std::deque<Retired>                     orphans;
+
+  auto reclaimable(const Retired& retired, uint64_t epoch) -> bool
+  {
+    return retired.epoch + 2 <= epoch;
+  }
+
+  void reclaim(const Retired& retired)
+  {
+    retired.deleter(retired.ptr);
+    --pending_count;
+  }
+
+  struct Local {
+    Record*             record = nullptr;
+    // ordered by retirement epoch, the epoch never goes backwards
+    std::deque<Retired> limbo;
+
+    ~Local()
+    {
+      if (nullptr != record) {
+        record->online = false;
+        record->claimed = false;
+      }
+      if (limbo.empty())
+        return;
+      std::unique_lock lock(mutex_orphans);
+      for (Retired& retired : limbo)
+        orphans.push_back(retired);
+    }
+
+    auto acquire() -> Record&
+    {
+      if (nullptr != record)
+        return *record;
+      for (std::size_t idx = 0; idx < records.size(); ++idx) {
+        bool expected = false;
+        if (!records[idx].claimed.compare_exchange_strong(expected, true))
+          continue;
+        std::size_t used = records_used.load();
+        while (used < idx + 1 && !records_used.compare_exchange_weak(used, idx + 1))
+          ;
+        record = &records[idx];
+        return *record;
+      }
+      std::clog << "[❌][EBR] more than " << Epoch::max_threads << " threads registered for reclamation\n";
+      std::abort();
+    }
+  };
+  thread_local Local local;
+}
+
+
+void Epoch::online()
+{
+  Record& record = local.acquire();
+  record.epoch = global_epoch.load();
+  record.online = true;
+}
+
+
+void Epoch::offline()
+{
+  if (nullptr != local.record)
+    local.record->online = false;
+}
+
+
+void Epoch::quiescent()
+{
+  if (is_online())
+    local.record->epoch = global_epoch.load();
+  // nothing waits to be freed anywhere, advancing would only bounce the global epoch's cache line between cores.
+  // `pending_count` covers every limbo list and the orphans
+  if (pending_count.load(std::memory_order_relaxed) == 0)
+    return;
+  try_advance();
+  collect();
+}
+
+
+void Epoch::retire(void* ptr, void (*deleter)(void*))
+{
+  local.limbo.push_back({ ptr, deleter, global_epoch.load() });
+  ++pending_count;
+  if (local.limbo.size() >= collect_threshold) {
+    try_advance();
+    collect();
+  }
+}
+
+
+auto Epoch::current() -> uint64_t
+{
+  return global_epoch.load();
+}
+
+
+auto Epoch::pending() -> std::size_t
+{
+  return pending_count.load();
+}
+
+
+Epoch::Guard::Guard()
+  : entered(!is_online())
+{
+  if (entered)
+    online();
+}
+
+
+Epoch::Guard::~Guard()
+{
+  if (entered)
+    offline();
+}
+
+
+auto Epoch::is_online() -> bool
+{
+  return nullptr != local.record && local.record->online.load(std::memory_order_relaxed);
+}
+
+
+void Epoch::try_advance()
+{
+  uint64_t epoch = global_epoch.load();
+  const std::size_t used = records_used.load();
+  for (std::size_t idx = 0; idx < used; ++idx) {
+    const Record& record = records[idx];
+    if (record.claimed.load() && record.online.load() && record.epoch.load() != epoch)
+      return;
+  }
+  global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+
+void Epoch::collect()
+{
+  const uint64_t epoch = global_epoch.load();
+  while (!local.limbo.empty() && reclaimable(local.limbo.front(), epoch)) {
+    reclaim(local.limbo.front());
+    local.limbo.pop_front();
+  }
+
+  std::unique_lock lock(mutex_orphans, std::try_to_lock);
+  if (!lock.owns_lock() || orphans.empty())
+    return;
+  std::erase_if(orphans, [epoch](const Retired& retired) {
+    if (!reclaimable(retired, epoch))
+      return false;
+    reclaim(retired);
+    return true;
+  });
+}
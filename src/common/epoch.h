@@ -0,0 +1,54 @@
+#ifndef COMMON_EPOCH_HEADER
+#define COMMON_EPOCH_HEADER
+#include <cstddef>
+#include <cstdint>
+
+// process-wide epoch-based reclamation for lock-free structures, quiescent-state flavoured.
+// a thread that is `online` may hold references into shared structures at any time, it gives them up
+// only at the points where it calls `quiescent` (Node's workers do so between tasks) or by going `offline`.
+// the global epoch advances once every online thread has been quiescent in the current epoch, memory
+// retired in epoch e is freed once the epoch reaches e + 2: every thread has passed a quiescent point
+// since it was unlinked. reads themselves cost nothing, no per-access atomics or fences.
+// threads outside the worker pool touch protected structures only inside a `Guard`.
+class Epoch
+{
+public:
+  static constexpr std::size_t max_threads = 256;
+
+  static void online();
+  static void offline();
+  // the calling thread holds no references right now. if anything is retired, tries to advance the epoch
+  // and frees what is safe
+  static void quiescent();
+
+  // `ptr` must already be unreachable for threads that reach it from here on
+  static void retire(void* ptr, void (*deleter)(void*));
+  template<typename T>
+  static void retire(T* ptr)
+  {
+    retire(ptr, [](void* retired) { delete static_cast<T*>(retired); });
+  }
+
+  static auto current() -> uint64_t;
+  // retired but not yet freed, summed over all threads
+  static auto pending() -> std::size_t;
+
+  // online for its scope, unless the thread already was
+  class Guard
+  {
+  public:
+    Guard();
+    ~Guard();
+    Guard(const Guard&) = delete;
+    auto operator=(const Guard&) -> Guard& = delete;
+  private:
+    bool entered;
+  };
+
+private:
+  static auto is_online() -> bool;
+  static void try_advance();
+  static void collect();
+};
+
+#endif
@@ -0,0 +1,547 @@
+#include "event_loop.h"
+#include "common/trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+  constexpr int64_t disarmed = INT64_MAX;
+  constexpr std::size_t chunk_size = 64 * 1024;
+  // a burst of buffered lines is never handed out for longer than this without the loop looking around
+  constexpr std::size_t lines_per_round = 64;
+
+  // what a completion or an epoll event belongs to
+  enum Tag : uint64_t {
+    INPUT,
+    WAKE,
+    TIMER,
+    OUTPUT,
+  };
+
+  auto since_epoch(std::chrono::steady_clock::time_point at) -> int64_t
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+  }
+}
+
+
+// just enough io_uring for the loop, without liburing: at most one operation per tag is in flight,
+// so eight entries never fill up
+struct EventLoopTransport::Ring
+{
+  static auto setup() -> std::unique_ptr<Ring>;
+  ~Ring();
+
+  void prepare(uint8_t opcode, int fd, void* addr, std::size_t len, Tag tag);
+  // submits what was prepared and, if `wait`, waits for at least one completion
+  auto enter(bool wait) -> bool;
+  template <typename fn>
+  void reap(fn&& on_completion);
+
+  int           fd          = -1;
+  void*         sq_map      = MAP_FAILED;
+  std::size_t   sq_size     = 0;
+  void*         cq_map      = MAP_FAILED;
+  std::size_t   cq_size     = 0;
+  io_uring_sqe* sqes        = static_cast<io_uring_sqe*>(MAP_FAILED);
+  std::size_t   sqes_size   = 0;
+  unsigned*     sq_tail     = nullptr;
+  unsigned*     sq_mask     = nullptr;
+  unsigned*     sq_array    = nullptr;
+  unsigned*     cq_head     = nullptr;
+  unsigned*     cq_tail     = nullptr;
+  unsigned*     cq_mask     = nullptr;
+  io_uring_cqe* cqes        = nullptr;
+  unsigned      to_submit   = 0;
+
+  bool          reading     = false;
+  bool          waking      = false;
+  bool          timing      = false;
+  bool          writing     = false;
+  uint64_t      wake_value  = 0;
+  uint64_t      timer_value = 0;
+};
+
+
+auto EventLoopTransport::Ring::setup() -> std::unique_ptr<Ring>
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  auto ring = std::make_unique<Ring>();
+  ring->fd = static_cast<int>(::syscall(__NR_io_uring_setup, 8, &params));
+  if (ring->fd < 0) {
+    std::clog << "[⚠️][NET] io_uring unavailable: " << std::strerror(errno) << '\n';
+    return nullptr;
+  }
+  // IORING_OP_READ/WRITE at the current position, what pipes and ttys need, came with this
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+    std::clog << "[⚠️][NET] io_uring cannot read and write at the current position on this kernel\n";
+    return nullptr;
+  }
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_map)
+    ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+  ring->sq_map = ::mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map != MAP_FAILED) {
+    ring->cq_map = single_map ? ring->sq_map
+      : ::mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  }
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  if (ring->cq_map != MAP_FAILED) {
+    ring->sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES));
+  }
+  if (ring->sqes == MAP_FAILED) {
+    std::clog << "[⚠️][NET] cannot map the io_uring queues: " << std::strerror(errno) << '\n';
+    return nullptr;
+  }
+  char* sq = static_cast<char*>(ring->sq_map);
+  char* cq = static_cast<char*>(ring->cq_map);
+  ring->sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  ring->sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  ring->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  ring->cq_head  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  ring->cq_tail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  ring->cq_mask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  ring->cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return ring;
+}
+
+
+EventLoopTransport::Ring::~Ring()
+{
+  if (sqes != MAP_FAILED)
+    ::munmap(sqes, sqes_size);
+  if (cq_map != MAP_FAILED && cq_map != sq_map)
+    ::munmap(cq_map, cq_size);
+  if (sq_map != MAP_FAILED)
+    ::munmap(sq_map, sq_size);
+  if (fd >= 0)
+    ::close(fd);
+}
+
+
+void EventLoopTransport::Ring::prepare(uint8_t opcode, int target, void* addr, std::size_t len, Tag tag)
+{
+  // the loop is the only producer, nobody else moves the tail
+  const unsigned tail = *sq_tail;
+  const unsigned index = tail & *sq_mask;
+  io_uring_sqe& sqe = sqes[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = opcode;
+  sqe.fd = target;
+  sqe.addr = reinterpret_cast<uint64_t>(addr);
+  sqe.len = static_cast<uint32_t>(len);
+  sqe.off = static_cast<uint64_t>(-1);
+  sqe.user_data = tag;
+  sq_array[index] = index;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++to_submit;
+}
+
+
+auto EventLoopTransport::Ring::enter(bool wait) -> bool
+{
+  while (true) {
+    const long submitted = ::syscall(__NR_io_uring_enter, fd, to_submit, wait ? 1 : 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (submitted >= 0) {
+      to_submit -= static_cast<unsigned>(submitted);
+      return true;
+    }
+    if (errno != EINTR) {
+      std::clog << "[❌][NET] io_uring_enter failed: " << std::strerror(errno) << '\n';
+      return false;
+    }
+  }
+}
+
+
+template <typename fn>
+void EventLoopTransport::Ring::reap(fn&& on_completion)
+{
+  unsigned head = *cq_head;
+  const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = cqes[head & *cq_mask];
+    on_completion(cqe.user_data, cqe.res);
+  }
+  __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+auto EventLoopTransport::create(int in_fd, int out_fd, bool allow_io_uring) -> std::unique_ptr<EventLoopTransport>
+{
+  const int wake_fd = ::eventfd(0, EFD_CLOEXEC);
+  const int timer_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (wake_fd < 0 || timer_fd < 0) {
+    std::clog << "[❌][NET] cannot create the event loop's eventfd or timerfd: " << std::strerror(errno) << '\n';
+    if (wake_fd >= 0)
+      ::close(wake_fd);
+    if (timer_fd >= 0)
+      ::close(timer_fd);
+    return nullptr;
+  }
+  std::unique_ptr<EventLoopTransport> loop(new EventLoopTransport(in_fd, out_fd, wake_fd, timer_fd));
+  if (allow_io_uring)
+    loop->ring = Ring::setup();
+  if (nullptr == loop->ring) {
+    loop->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+      std::clog << "[❌][NET] epoll_create1 failed: " << std::strerror(errno) << '\n';
+      return nullptr;
+    }
+    for (const auto& [fd, tag] : { std::pair{ wake_fd, WAKE }, std::pair{ timer_fd, TIMER }, std::pair{ in_fd, INPUT } }) {
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = tag;
+      if (::epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)
+        continue;
+      if (fd == in_fd && errno == EPERM) {
+        loop->in_always_ready = true;
+        continue;
+      }
+      std::clog << "[❌][NET] cannot poll fd " << fd << ": " << std::strerror(errno) << '\n';
+      return nullptr;
+    }
+  }
+  std::clog << "[✅][NET] event loop running on " << (loop->ring ? "io_uring" : "epoll") << '\n';
+  return loop;
+}
+
+
+EventLoopTransport::EventLoopTransport(int in_fd, int out_fd, int wake_fd, int timer_fd)
+  : in_fd(in_fd)
+  , out_fd(out_fd)
+  , wake_fd(wake_fd)
+  , timer_fd(timer_fd)
+  , epoll_fd(-1)
+  , in_always_ready(false)
+  , armed(disarmed)
+  , chunk(new char[chunk_size])
+  , consumed(0)
+  , scanned(0)
+  , handed_out(0)
+  , input_closed(false)
+  , written(0)
+  , wake_pending(false)
+{
+}
+
+
+EventLoopTransport::~EventLoopTransport()
+{
+  // the kernel may still be reading into `chunk` or from `writing`, the ring goes before them
+  ring.reset();
+  if (epoll_fd >= 0)
+    ::close(epoll_fd);
+  ::close(wake_fd);
+  ::close(timer_fd);
+}
+
+
+auto EventLoopTransport::backend() const -> Backend
+{
+  return ring ? IO_URING : EPOLL;
+}
+
+
+auto EventLoopTransport::read(std::string& line) -> bool
+{
+  while (true) {
+    if (const std::size_t end = input.find('\n', scanned); end != std::string::npos) {
+      line.assign(input, consumed, end - consumed);
+      consumed = scanned = end + 1;
+      between_lines();
+      return true;
+    }
+    scanned = input.size();
+    if (input_closed) {
+      // like getline, a last line without its newline still counts
+      if (consumed == input.size())
+        return false;
+      line.assign(input, consumed);
+      consumed = scanned = input.size();
+      return true;
+    }
+    poll(true);
+  }
+}
+
+
+void EventLoopTransport::between_lines()
+{
+  // completions sit in shared memory, reaping them costs no syscall: finished writes, fired timers
+  if (ring)
+    ring->reap(std::bind(&EventLoopTransport::complete, this, std::placeholders::_1, std::placeholders::_2));
+  const bool timer_due = armed.load(std::memory_order_relaxed) <= since_epoch(std::chrono::steady_clock::now());
+  if (timer_due || ++handed_out >= lines_per_round || ((!ring || !ring->writing) && output_waiting()))
+    poll(false);
+}
+
+
+void EventLoopTransport::send(const Message& msg)
+{
+  std::string line;
+  {
+    Trace::Span span("serialize", msg.type);
+    line = msg.as_json().dump();
+  }
+  {
+    Trace::Span span("write", msg.type);
+    std::unique_lock lock(mutex_outbox);
+    outbox.append(line).push_back('\n');
+  }
+  signal();
+}
+
+
+auto EventLoopTransport::drive_timers(next_timer_fn next, fire_timers_fn fire) -> bool
+{
+  next_timer = std::move(next);
+  fire_timers = std::move(fire);
+  return true;
+}
+
+
+void EventLoopTransport::timer_scheduled(std::chrono::steady_clock::time_point due)
+{
+  // a later timer is picked up when the armed one fires
+  if (since_epoch(due) < armed.load(std::memory_order_relaxed))
+    signal();
+}
+
+
+void EventLoopTransport::close()
+{
+  // the reader is done, what the workers sent since goes out synchronously
+  while (ring && ring->writing && ring->enter(true))
+    ring->reap(std::bind(&EventLoopTransport::complete, this, std::placeholders::_1, std::placeholders::_2));
+  while (take_outbox()) {
+    const ssize_t put = ::write(out_fd, writing.data() + written, writing.size() - written);
+    on_written(put < 0 ? -errno : put);
+  }
+}
+
+
+void EventLoopTransport::poll(bool wait)
+{
+  handed_out = 0;
+  arm_timer();
+  if (ring)
+    poll_ring(wait);
+  else
+    poll_epoll(wait);
+}
+
+
+void EventLoopTransport::poll_ring(bool wait)
+{
+  // more input is only asked for once the buffered lines ran out, a slow reader keeps pushing back on stdin
+  if (wait && !ring->reading && !input_closed) {
+    ring->prepare(IORING_OP_READ, in_fd, chunk.get(), chunk_size, INPUT);
+    ring->reading = true;
+  }
+  if (!ring->waking) {
+    ring->prepare(IORING_OP_READ, wake_fd, &ring->wake_value, sizeof(ring->wake_value), WAKE);
+    ring->waking = true;
+  }
+  if (!ring->timing) {
+    ring->prepare(IORING_OP_READ, timer_fd, &ring->timer_value, sizeof(ring->timer_value), TIMER);
+    ring->timing = true;
+  }
+  if (!ring->writing && take_outbox()) {
+    ring->prepare(IORING_OP_WRITE, out_fd, writing.data() + written, writing.size() - written, OUTPUT);
+    ring->writing = true;
+  }
+  if (!ring->enter(wait)) {
+    input_closed = true;
+    return;
+  }
+  ring->reap(std::bind(&EventLoopTransport::complete, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+
+void EventLoopTransport::poll_epoll(bool wait)
+{
+  if (take_outbox()) {
+    const ssize_t put = ::write(out_fd, writing.data() + written, writing.size() - written);
+    on_written(put < 0 ? -errno : put);
+  }
+  if (wait && in_always_ready && !input_closed) {
+    const ssize_t got = ::read(in_fd, chunk.get(), chunk_size);
+    on_input(got < 0 ? -errno : got);
+  }
+  // a partial write or an unpollable stdin must not leave us waiting
+  const bool busy = !wait || written < writing.size() || (in_always_ready && !input_closed);
+  epoll_event events[3];
+  const int ready = ::epoll_wait(epoll_fd, events, 3, busy ? 0 : -1);
+  if (ready < 0 && errno != EINTR) {
+    std::clog << "[❌][NET] epoll_wait failed: " << std::strerror(errno) << '\n';
+    input_closed = true;
+    return;
+  }
+  for (int idx = 0; idx < ready; ++idx) {
+    uint64_t value;
+    switch (events[idx].data.u64) {
+      case INPUT: {
+        // level triggered, still readable once the buffered lines ran out
+        if (input_closed || !wait)
+          break;
+        const ssize_t got = ::read(in_fd, chunk.get(), chunk_size);
+        on_input(got < 0 ? -errno : got);
+        break;
+      }
+      case WAKE:
+        if (::read(wake_fd, &value, sizeof(value)) == sizeof(value))
+          on_wake();
+        break;
+      case TIMER:
+        if (::read(timer_fd, &value, sizeof(value)) == sizeof(value))
+          on_timer();
+        break;
+    }
+  }
+}
+
+
+void EventLoopTransport::complete(uint64_t tag, ssize_t result)
+{
+  switch (tag) {
+    case INPUT:
+      ring->reading = false;
+      on_input(result);
+      break;
+    case WAKE:
+      ring->waking = false;
+      if (result == sizeof(ring->wake_value))
+        on_wake();
+      break;
+    case TIMER:
+      ring->timing = false;
+      if (result == sizeof(ring->timer_value))
+        on_timer();
+      break;
+    case OUTPUT:
+      ring->writing = false;
+      on_written(result);
+      break;
+  }
+}
+
+
+void EventLoopTransport::arm_timer()
+{
+  if (!next_timer)
+    return;
+  const std::optional<std::chrono::steady_clock::time_point> due = next_timer();
+  if (!due.has_value())
+    return;
+  // an all-zero expiry disarms, a timer that is already due still needs a deadline
+  const int64_t at = std::max<int64_t>(since_epoch(due.value()), 1);
+  if (at >= armed.load(std::memory_order_relaxed))
+    return;
+  itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = at / 1000000000;
+  spec.it_value.tv_nsec = at % 1000000000;
+  if (::timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    std::clog << "[❌][NET] timerfd_settime failed: " << std::strerror(errno) << '\n';
+    return;
+  }
+  armed.store(at, std::memory_order_relaxed);
+}
+
+
+void EventLoopTransport::on_input(ssize_t result)
+{
+  if (result == -EINTR || result == -EAGAIN)
+    return;
+  if (result < 0)
+    std::clog << "[❌][NET] read failed: " << std::strerror(-result) << '\n';
+  if (result <= 0) {
+    input_closed = true;
+    return;
+  }
+  if (consumed > 0) {
+    input.erase(0, consumed);
+    scanned -= consumed;
+    consumed = 0;
+  }
+  input.append(chunk.get(), result);
+}
+
+
+void EventLoopTransport::on_written(ssize_t result)
+{
+  if (result == -EINTR || result == -EAGAIN)
+    return;
+  if (result < 0) {
+    std::clog << "[❌][NET] write failed, dropping " << writing.size() - written << " bytes: " << std::strerror(-result) << '\n';
+    result = writing.size() - written;
+  }
+  written += result;
+  if (written == writing.size()) {
+    writing.clear();
+    written = 0;
+  }
+}
+
+
+void EventLoopTransport::on_wake()
+{
+  // cleared before the outbox is taken, a send after the take signals again
+  wake_pending.store(false);
+}
+
+
+void EventLoopTransport::on_timer()
+{
+  armed.store(disarmed, std::memory_order_relaxed);
+  if (fire_timers)
+    fire_timers();
+}
+
+
+auto EventLoopTransport::output_waiting() -> bool
+{
+  if (written < writing.size())
+    return true;
+  std::unique_lock lock(mutex_outbox);
+  return !outbox.empty();
+}
+
+
+auto EventLoopTransport::take_outbox() -> bool
+{
+  if (written < writing.size())
+    return true;
+  std::unique_lock lock(mutex_outbox);
+  if (outbox.empty())
+    return false;
+  // the drained buffer goes back as the next outbox, both keep their capacity
+  writing.swap(outbox);
+  outbox.clear();
+  written = 0;
+  return true;
+}
+
+
+void EventLoopTransport::signal()
+{
+  if (wake_pending.exchange(true))
+    return;
+  const uint64_t one = 1;
+  if (::write(wake_fd, &one, sizeof(one)) != sizeof(one))
+    std::clog << "[❌][NET] cannot wake the event loop: " << std::strerror(errno) << '\n';
+}
@@ -0,0 +1,94 @@
+#ifndef COMMON_EVENT_LOOP_HEADER
+#define COMMON_EVENT_LOOP_HEADER
+#include "transport.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+
+// a transport that waits on input, output and the node's timers in one completion loop run by the reader thread.
+// sends from the workers are appended to an outbox and go out in batches, one write for everything that piled up
+// while the previous write was in flight. timers are kept on a timerfd, so the node needs no timer thread.
+// the loop runs on io_uring where the kernel allows it and on epoll otherwise. while buffered lines are handed
+// out the loop does not wait, but it still flushes output and fires due timers between them.
+class EventLoopTransport final : public Transport
+{
+public:
+  enum Backend {
+    IO_URING,
+    EPOLL,
+  };
+
+  // nullptr if neither backend can be set up
+  static auto create(int in_fd, int out_fd, bool allow_io_uring = true) -> std::unique_ptr<EventLoopTransport>;
+  ~EventLoopTransport() override;
+  EventLoopTransport(const EventLoopTransport&) = delete;
+  auto operator=(const EventLoopTransport&) -> EventLoopTransport& = delete;
+
+  auto backend() const -> Backend;
+
+  auto read(std::string& line) -> bool override;
+  void send(const Message& msg) override;
+  auto drive_timers(next_timer_fn next, fire_timers_fn fire) -> bool override;
+  void timer_scheduled(std::chrono::steady_clock::time_point due) override;
+  void close() override;
+
+private:
+  struct Ring;
+  EventLoopTransport(int in_fd, int out_fd, int wake_fd, int timer_fd);
+
+  // one round of the loop: arms the timer, starts a write if there is output, then, if `wait`, reads more input
+  // and waits for at least one event
+  void poll(bool wait);
+  void poll_ring(bool wait);
+  void poll_epoll(bool wait);
+  // a round without waiting when output, a due timer or `lines_per_round` handed out lines call for one
+  void between_lines();
+  void arm_timer();
+  // `result` is what read(2) or write(2) returned, or the negated errno
+  void on_input(ssize_t result);
+  void on_written(ssize_t result);
+  void on_wake();
+  void on_timer();
+  void complete(uint64_t tag, ssize_t result);
+  // moves the outbox into the write buffer if no write is in flight, false if there is nothing to write
+  auto take_outbox() -> bool;
+  auto output_waiting() -> bool;
+  void signal();
+
+  const int               in_fd;
+  const int               out_fd;
+  const int               wake_fd;
+  const int               timer_fd;
+  std::unique_ptr<Ring>   ring;
+  int                     epoll_fd;
+  // stdin redirected from a regular file cannot be polled, it is always readable
+  bool                    in_always_ready;
+
+  next_timer_fn           next_timer;
+  fire_timers_fn          fire_timers;
+  // nanoseconds since the steady epoch of the deadline on the timerfd, INT64_MAX if disarmed
+  std::atomic<int64_t>    armed;
+
+  // touched by the reader thread only
+  std::unique_ptr<char[]> chunk;
+  std::string             input;
+  // lines before `consumed` were handed out, no newline before `scanned`
+  std::size_t             consumed;
+  std::size_t             scanned;
+  // since the last round of the loop
+  std::size_t             handed_out;
+  bool                    input_closed;
+  std::string             writing;
+  std::size_t             written;
+
+  std::mutex              mutex_outbox;
+  std::string             outbox;
+  // set by whoever signals the wake fd, cleared by the loop once it consumed the signal
+  std::atomic<bool>       wake_pending;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "hash_ring.h"
+#include <algorithm>
+
+
+HashRing::HashRing(const std::vector<std::string>& node_ids, int virtual_nodes)
+  : nodes(node_ids)
+{
+  points.reserve(nodes.size() * virtual_nodes);
+  for (std::size_t node_idx = 0; node_idx < nodes.size(); ++node_idx) {
+    for (int vnode = 0; vnode < virtual_nodes; ++vnode) {
+      std::string label = nodes[node_idx] + '#' + std::to_string(vnode);
+      points.push_back({ hash(label), node_idx });
+    }
+  }
+  std::sort(points.begin(), points.end(), [](const Point& lhs, const Point& rhs) { return lhs.hash < rhs.hash; });
+}
+
+
+auto HashRing::owner(std::string_view key) const -> const std::string&
+{
+  const uint64_t key_hash = hash(key);
+  auto found = std::lower_bound(points.begin(), points.end(), key_hash,
+    [](const Point& point, uint64_t h) { return point.hash < h; });
+  if (found == points.end())
+    found = points.begin();
+  return nodes[found->node_idx];
+}
+
+
+auto HashRing::hash(std::string_view data) -> uint64_t
+{
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (const char c : data) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 0x100000001b3ull;
+  }
+  // fnv alone clusters similar labels ("n1#1", "n1#2"), finish with murmur3's fmix64
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
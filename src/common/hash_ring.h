@@ -0,0 +1,32 @@
+#ifndef COMMON_HASH_RING_HEADER
+#define COMMON_HASH_RING_HEADER
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// consistent hash ring over a fixed set of node ids.
+// every node is placed on the ring `virtual_nodes` times so keys spread evenly even for small clusters,
+// hashing is 64-bit FNV-1a finished with a murmur3 fmix64, every node in the cluster has to compute exactly
+// this function to agree on the owner of a key.
+class HashRing
+{
+public:
+  HashRing() = default;
+  HashRing(const std::vector<std::string>& node_ids, int virtual_nodes = 64);
+
+  auto owner(std::string_view key) const -> const std::string&;
+  auto empty() const -> bool { return points.empty(); }
+
+  static auto hash(std::string_view data) -> uint64_t;
+
+private:
+  struct Point {
+    uint64_t    hash;
+    std::size_t node_idx;
+  };
+  std::vector<Point>        points;
+  std::vector<std::string>  nodes;
+};
+
+#endif
@@ -9,6 +9,8 @@ auto message_type_from_string(std::string_view raw) -> const MessageType
 {
   // is case-sensitivity okay if not good in the case of RPC?
   const std::unordered_map<std::string_view, MessageType> conversion_map = {
+    { "error",        ERROR_RES },
+
     { "init",         INIT_REQ },
     { "init_ok",      INIT_RES },
 
@@ -17,6 +19,48 @@ auto message_type_from_string(std::string_view raw) -> const MessageType
 
     { "generate",     GENERATE_REQ },
     { "generate_ok",  GENERATE_RES },
+
+    { "send",         SEND_REQ },
+    { "send_ok",      SEND_RES },
+
+    { "poll",         POLL_REQ },
+    { "poll_ok",      POLL_RES },
+
+    { "commit_offsets",             COMMIT_OFFSETS_REQ },
+    { "commit_offsets_ok",          COMMIT_OFFSETS_RES },
+
+    { "list_committed_offsets",     LIST_COMMITTED_OFFSETS_REQ },
+    { "list_committed_offsets_ok",  LIST_COMMITTED_OFFSETS_RES },
+
+    { "kafka_append",     KAFKA_APPEND_REQ },
+    { "kafka_append_ok",  KAFKA_APPEND_RES },
+
+    { "read",         READ_REQ },
+    { "read_ok",      READ_RES },
+
+    { "write",        WRITE_REQ },
+    { "write_ok",     WRITE_RES },
+
+    { "cas",          CAS_REQ },
+    { "cas_ok",       CAS_RES },
+
+    { "request_vote",       REQUEST_VOTE_REQ },
+    { "request_vote_ok",    REQUEST_VOTE_RES },
+
+    { "append_entries",     APPEND_ENTRIES_REQ },
+    { "append_entries_ok",  APPEND_ENTRIES_RES },
+
+    { "install_snapshot",     INSTALL_SNAPSHOT_REQ },
+    { "install_snapshot_ok",  INSTALL_SNAPSHOT_RES },
+
+    { "txn",      TXN_REQ },
+    { "txn_ok",   TXN_RES },
+
+    { "txn_replicate",    TXN_REPLICATE_REQ },
+    { "txn_replicate_ok", TXN_REPLICATE_RES },
+
+    { "stats",    STATS_REQ },
+    { "stats_ok", STATS_RES },
   };
   auto found = conversion_map.find(raw);
   return found == conversion_map.end() ? INVALID : found->second;
@@ -29,6 +73,9 @@ auto message_type_to_string(MessageType type) -> const std::string_view
   using namespace std::string_view_literals;
   switch (type) {
     case INVALID: break;
+    case MESSAGE_TYPE_COUNT: break;
+
+    case ERROR_RES: return "error"sv;
 
     case INIT_REQ: return "init"sv;
     case INIT_RES: return "init_ok"sv;
@@ -38,6 +85,48 @@ auto message_type_to_string(MessageType type) -> const std::string_view
 
     case GENERATE_REQ: return "generate"sv;
     case GENERATE_RES: return "generate_ok"sv;
+
+    case SEND_REQ: return "send"sv;
+    case SEND_RES: return "send_ok"sv;
+
+    case POLL_REQ: return "poll"sv;
+    case POLL_RES: return "poll_ok"sv;
+
+    case COMMIT_OFFSETS_REQ: return "commit_offsets"sv;
+    case COMMIT_OFFSETS_RES: return "commit_offsets_ok"sv;
+
+    case LIST_COMMITTED_OFFSETS_REQ: return "list_committed_offsets"sv;
+    case LIST_COMMITTED_OFFSETS_RES: return "list_committed_offsets_ok"sv;
+
+    case KAFKA_APPEND_REQ: return "kafka_append"sv;
+    case KAFKA_APPEND_RES: return "kafka_append_ok"sv;
+
+    case READ_REQ: return "read"sv;
+    case READ_RES: return "read_ok"sv;
+
+    case WRITE_REQ: return "write"sv;
+    case WRITE_RES: return "write_ok"sv;
+
+    case CAS_REQ: return "cas"sv;
+    case CAS_RES: return "cas_ok"sv;
+
+    case REQUEST_VOTE_REQ: return "request_vote"sv;
+    case REQUEST_VOTE_RES: return "request_vote_ok"sv;
+
+    case APPEND_ENTRIES_REQ: return "append_entries"sv;
+    case APPEND_ENTRIES_RES: return "append_entries_ok"sv;
+
+    case INSTALL_SNAPSHOT_REQ: return "install_snapshot"sv;
+    case INSTALL_SNAPSHOT_RES: return "install_snapshot_ok"sv;
+
+    case TXN_REQ: return "txn"sv;
+    case TXN_RES: return "txn_ok"sv;
+
+    case TXN_REPLICATE_REQ: return "txn_replicate"sv;
+    case TXN_REPLICATE_RES: return "txn_replicate_ok"sv;
+
+    case STATS_REQ: return "stats"sv;
+    case STATS_RES: return "stats_ok"sv;
   }
   // should probably be very pissy and throwing an error instead / aborting, garbage in system panic out
   // addendum: no? are you stupid? garbage in error message out
@@ -81,8 +170,8 @@ auto Message::from_json(const json& json_msg) -> std::optional<Message> {
       : Snowflake::invalid();
 
   const Snowflake reply_id =
-    json_msg["body"].contains("is_reply_to")
-      ? Snowflake::from_json(json_msg["body"]["is_reply_to"]).value_or(Snowflake::invalid())
+    json_msg["body"].contains("in_reply_to")
+      ? Snowflake::from_json(json_msg["body"]["in_reply_to"]).value_or(Snowflake::invalid())
       : Snowflake::invalid();
   
   if (parsed_type == INVALID)
@@ -131,6 +220,22 @@ auto Message::create_response() const -> Message
     case ECHO_REQ:      response_type = ECHO_RES; break;
     case GENERATE_REQ:  response_type = GENERATE_RES; break;
 
+    case SEND_REQ:                    response_type = SEND_RES; break;
+    case POLL_REQ:                    response_type = POLL_RES; break;
+    case COMMIT_OFFSETS_REQ:          response_type = COMMIT_OFFSETS_RES; break;
+    case LIST_COMMITTED_OFFSETS_REQ:  response_type = LIST_COMMITTED_OFFSETS_RES; break;
+    case KAFKA_APPEND_REQ:            response_type = KAFKA_APPEND_RES; break;
+
+    case READ_REQ:                    response_type = READ_RES; break;
+    case WRITE_REQ:                   response_type = WRITE_RES; break;
+    case CAS_REQ:                     response_type = CAS_RES; break;
+    case REQUEST_VOTE_REQ:            response_type = REQUEST_VOTE_RES; break;
+    case APPEND_ENTRIES_REQ:          response_type = APPEND_ENTRIES_RES; break;
+    case INSTALL_SNAPSHOT_REQ:        response_type = INSTALL_SNAPSHOT_RES; break;
+    case TXN_REQ:                     response_type = TXN_RES; break;
+    case TXN_REPLICATE_REQ:           response_type = TXN_REPLICATE_RES; break;
+    case STATS_REQ:                   response_type = STATS_RES; break;
+
     default:
       std::cerr << "unimplemented response for message of type '" << message_type_to_string(type) << "'\n";
       return Message();
@@ -139,6 +244,14 @@ auto Message::create_response() const -> Message
   return response;
 }
 
+auto Message::create_error(ErrorCode code, std::string_view text) const -> Message
+{
+  Message error(ERROR_RES, Snowflake::generate_64(), id, to, from);
+  error.body["code"] = static_cast<int>(code);
+  error.body["text"] = text;
+  return error;
+}
+
 auto Message::as_json() const -> json
 {
   json as_json = {
@@ -9,6 +9,8 @@ enum MessageType
 {
   INVALID,
 
+  ERROR_RES,
+
   INIT_REQ,
   INIT_RES,
 
@@ -17,10 +19,71 @@ enum MessageType
 
   GENERATE_REQ,
   GENERATE_RES,
+
+  SEND_REQ,
+  SEND_RES,
+
+  POLL_REQ,
+  POLL_RES,
+
+  COMMIT_OFFSETS_REQ,
+  COMMIT_OFFSETS_RES,
+
+  LIST_COMMITTED_OFFSETS_REQ,
+  LIST_COMMITTED_OFFSETS_RES,
+
+  KAFKA_APPEND_REQ,
+  KAFKA_APPEND_RES,
+
+  READ_REQ,
+  READ_RES,
+
+  WRITE_REQ,
+  WRITE_RES,
+
+  CAS_REQ,
+  CAS_RES,
+
+  REQUEST_VOTE_REQ,
+  REQUEST_VOTE_RES,
+
+  APPEND_ENTRIES_REQ,
+  APPEND_ENTRIES_RES,
+
+  INSTALL_SNAPSHOT_REQ,
+  INSTALL_SNAPSHOT_RES,
+
+  TXN_REQ,
+  TXN_RES,
+
+  TXN_REPLICATE_REQ,
+  TXN_REPLICATE_RES,
+
+  STATS_REQ,
+  STATS_RES,
+
+  // not a type, keep last
+  MESSAGE_TYPE_COUNT,
 };
 auto message_type_from_string(std::string_view raw) -> const MessageType;
 auto message_type_to_string(MessageType type) -> const std::string_view;
 
+// maelstrom's error codes, carried in the 'code' field of an 'error' message
+enum ErrorCode : int
+{
+  ERR_TIMEOUT                 = 0,
+  ERR_NODE_NOT_FOUND          = 1,
+  ERR_NOT_SUPPORTED           = 10,
+  ERR_TEMPORARILY_UNAVAILABLE = 11,
+  ERR_MALFORMED_REQUEST       = 12,
+  ERR_CRASH                   = 13,
+  ERR_ABORT                   = 14,
+  ERR_KEY_DOES_NOT_EXIST      = 20,
+  ERR_KEY_ALREADY_EXISTS      = 21,
+  ERR_PRECONDITION_FAILED     = 22,
+  ERR_TXN_CONFLICT            = 30,
+};
+
 class Message {
   using json = nlohmann::json;
 public:
@@ -34,6 +97,7 @@ public:
   Message(MessageType type, Snowflake id, Snowflake reply_id, std::string_view from, std::string_view to);
 
   auto create_response() const -> Message;
+  auto create_error(ErrorCode code, std::string_view text) const -> Message;
   auto as_json() const -> json;
 private:
 
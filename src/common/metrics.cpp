@@ -0,0 +1,234 @@
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+  constexpr std::size_t type_count = MESSAGE_TYPE_COUNT;
+
+  struct Buckets {
+    std::array<std::atomic<uint64_t>, Metrics::bucket_count> counts{};
+    std::atomic<uint64_t> total   = 0;
+    std::atomic<uint64_t> sum     = 0;
+    std::atomic<uint64_t> maximum = 0;
+  };
+
+  // a slot outlives the thread that claimed it, the next thread to claim it keeps adding to its sums
+  struct alignas(64) Slot {
+    std::atomic<bool>     claimed = false;
+    std::array<std::array<std::atomic<Buckets*>, Metrics::STAGE_COUNT>, type_count> histograms{};
+    std::array<std::atomic<uint64_t>, Metrics::COUNTER_COUNT> counters{};
+  };
+
+  std::array<Slot, Metrics::max_threads>  slots;
+  std::atomic<std::size_t>                slots_used = 0;
+  // threads past `max_threads` share this one and pay for atomic increments
+  Slot                                    overflow;
+
+  // the owning thread is the only writer of its slot, a load and a store is all an increment takes
+  void bump(std::atomic<uint64_t>& cell, uint64_t amount, bool shared)
+  {
+    if (shared)
+      cell.fetch_add(amount, std::memory_order_relaxed);
+    else
+      cell.store(cell.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  struct Local {
+    Slot* slot    = nullptr;
+    bool  shared  = false;
+
+    ~Local()
+    {
+      if (nullptr != slot && !shared)
+        slot->claimed.store(false, std::memory_order_release);
+    }
+
+    auto acquire() -> Slot&
+    {
+      if (nullptr != slot)
+        return *slot;
+      for (std::size_t idx = 0; idx < slots.size(); ++idx) {
+        bool expected = false;
+        if (!slots[idx].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+          continue;
+        std::size_t used = slots_used.load();
+        while (used < idx + 1 && !slots_used.compare_exchange_weak(used, idx + 1))
+          ;
+        slot = &slots[idx];
+        return *slot;
+      }
+      slot = &overflow;
+      shared = true;
+      return *slot;
+    }
+  };
+  thread_local Local local;
+
+  template<typename Fn>
+  void for_each_slot(Fn&& fn)
+  {
+    const std::size_t used = slots_used.load(std::memory_order_acquire);
+    for (std::size_t idx = 0; idx < used; ++idx)
+      fn(slots[idx]);
+    fn(overflow);
+  }
+}
+
+
+void Metrics::record(MessageType type, Stage stage, std::chrono::nanoseconds elapsed)
+{
+  if (type < 0 || static_cast<std::size_t>(type) >= type_count)
+    return;
+  Slot& slot = local.acquire();
+  std::atomic<Buckets*>& cell = slot.histograms[type][stage];
+  Buckets* buckets = cell.load(std::memory_order_acquire);
+  if (nullptr == buckets) {
+    Buckets* created = new Buckets();
+    // only the overflow slot can race on this
+    if (cell.compare_exchange_strong(buckets, created, std::memory_order_acq_rel))
+      buckets = created;
+    else
+      delete created;
+  }
+  const uint64_t value = std::max<int64_t>(elapsed.count(), 0);
+  bump(buckets->counts[bucket_of(value)], 1, local.shared);
+  bump(buckets->total, 1, local.shared);
+  bump(buckets->sum, value, local.shared);
+  uint64_t seen = buckets->maximum.load(std::memory_order_relaxed);
+  while (seen < value && !buckets->maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+    ;
+}
+
+
+void Metrics::count(Counter counter, uint64_t amount)
+{
+  bump(local.acquire().counters[counter], amount, local.shared);
+}
+
+
+auto Metrics::histogram(MessageType type, Stage stage) -> Histogram
+{
+  Histogram merged;
+  if (type < 0 || static_cast<std::size_t>(type) >= type_count)
+    return merged;
+  for_each_slot([&](const Slot& slot) {
+    const Buckets* buckets = slot.histograms[type][stage].load(std::memory_order_acquire);
+    if (nullptr == buckets)
+      return;
+    for (std::size_t idx = 0; idx < bucket_count; ++idx)
+      merged.buckets[idx] += buckets->counts[idx].load(std::memory_order_relaxed);
+    merged.total += buckets->total.load(std::memory_order_relaxed);
+    merged.sum += buckets->sum.load(std::memory_order_relaxed);
+    merged.maximum = std::max(merged.maximum, buckets->maximum.load(std::memory_order_relaxed));
+  });
+  return merged;
+}
+
+
+auto Metrics::counter(Counter counter) -> uint64_t
+{
+  uint64_t total = 0;
+  for_each_slot([&](const Slot& slot) {
+    total += slot.counters[counter].load(std::memory_order_relaxed);
+  });
+  return total;
+}
+
+
+auto Metrics::Histogram::percentile(double quantile) const -> uint64_t
+{
+  // the buckets are summed without a snapshot, they may add up to a little more than `total`
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+  uint64_t seen = 0;
+  for (std::size_t idx = 0; idx < bucket_count; ++idx) {
+    seen += buckets[idx];
+    if (seen >= rank)
+      return std::min(bucket_upper(idx), maximum);
+  }
+  return maximum;
+}
+
+
+auto Metrics::bucket_of(uint64_t nanoseconds) -> std::size_t
+{
+  constexpr uint64_t linear = uint64_t(1) << sub_bits;
+  if (nanoseconds < linear)
+    return nanoseconds;
+  const int exponent = std::bit_width(nanoseconds) - 1;
+  if (exponent > max_exponent)
+    return bucket_count - 1;
+  const uint64_t mantissa = nanoseconds >> (exponent - sub_bits);
+  return ((exponent - sub_bits + 1) << sub_bits) + (mantissa - linear);
+}
+
+
+auto Metrics::bucket_upper(std::size_t bucket) -> uint64_t
+{
+  constexpr uint64_t linear = uint64_t(1) << sub_bits;
+  if (bucket < linear)
+    return bucket;
+  const int exponent = static_cast<int>(bucket >> sub_bits) + sub_bits - 1;
+  const uint64_t mantissa = linear + (bucket & (linear - 1));
+  return ((mantissa + 1) << (exponent - sub_bits)) - 1;
+}
+
+
+auto Metrics::stage_name(Stage stage) -> const char*
+{
+  switch (stage) {
+    case QUEUE_WAIT:  return "queue_wait";
+    case HANDLER:     return "handler";
+    case WRITE_OUT:   return "write_out";
+    case STAGE_COUNT: break;
+  }
+  return "unknown";
+}
+
+
+auto Metrics::counter_name(Counter counter) -> const char*
+{
+  switch (counter) {
+    case MESSAGES_IN:               return "messages_in";
+    case MESSAGES_OUT:              return "messages_out";
+    case PARSE_FAILURES:            return "parse_failures";
+    case DROPPED:                   return "dropped";
+    case BUSY_NANOSECONDS:          return "busy_ns";
+    case SHED:                      return "shed";
+    case REJECTED:                  return "rejected";
+    case BACKPRESSURE_NANOSECONDS:  return "backpressure_ns";
+    case COUNTER_COUNT:             break;
+  }
+  return "unknown";
+}
+
+
+void Metrics::dump(std::ostream& out)
+{
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-26s %-10s %10s %10s %10s %10s %10s %10s\n",
+    "type", "stage", "count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+  out << "[📊][MET] latencies:\n" << line;
+  for (std::size_t type = 0; type < type_count; ++type) {
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+      const Histogram merged = histogram(static_cast<MessageType>(type), static_cast<Stage>(stage));
+      if (merged.count() == 0)
+        continue;
+      // timers run as tasks without a message
+      const std::string_view name = type == INVALID ? "(task)" : message_type_to_string(static_cast<MessageType>(type));
+      std::snprintf(line, sizeof(line), "%-26.*s %-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+        static_cast<int>(name.size()), name.data(), stage_name(static_cast<Stage>(stage)),
+        static_cast<unsigned long long>(merged.count()),
+        merged.percentile(0.5) / 1e3, merged.percentile(0.9) / 1e3, merged.percentile(0.99) / 1e3,
+        merged.percentile(0.999) / 1e3, merged.max() / 1e3);
+      out << line;
+    }
+  }
+  out << "[📊][MET] counters:";
+  for (int idx = 0; idx < COUNTER_COUNT; ++idx)
+    out << ' ' << counter_name(static_cast<Counter>(idx)) << '=' << counter(static_cast<Counter>(idx));
+  out << '\n';
+}
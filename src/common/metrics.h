@@ -0,0 +1,81 @@
+#ifndef COMMON_METRICS_HEADER
+#define COMMON_METRICS_HEADER
+#include "message.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// process-wide latency histograms per message type and stage, plus message counters.
+// every thread records into buckets of its own, written with plain relaxed stores since it is their only
+// writer, so recording never contends. readers sum all threads' buckets on demand.
+// histograms are HDR-style log-linear: 16 linear sub-buckets per power of two of nanoseconds, every value
+// lands in a bucket within ~6% of it, up to ~18 minutes.
+class Metrics
+{
+public:
+  enum Stage : int {
+    // enqueued until a worker picks it up
+    QUEUE_WAIT,
+    // the handler itself, keyed by the request's type
+    HANDLER,
+    // serializing and writing a message, keyed by the outgoing message's type
+    WRITE_OUT,
+    STAGE_COUNT,
+  };
+  enum Counter : int {
+    MESSAGES_IN,
+    MESSAGES_OUT,
+    PARSE_FAILURES,
+    // dropped before init or for lack of a handler
+    DROPPED,
+    // summed over all workers, time spent running tasks
+    BUSY_NANOSECONDS,
+    // requests dropped or refused because the task queue was full, see Node::set_queue_limit
+    SHED,
+    REJECTED,
+    // time the reader spent waiting for room in a full task queue
+    BACKPRESSURE_NANOSECONDS,
+    COUNTER_COUNT,
+  };
+
+  static constexpr std::size_t max_threads  = 256;
+  static constexpr int         sub_bits     = 4;
+  static constexpr int         max_exponent = 40;
+  static constexpr std::size_t bucket_count = (max_exponent - sub_bits + 2) << sub_bits;
+
+  // merged copy of one histogram, safe to inspect at leisure
+  class Histogram
+  {
+  public:
+    auto count() const -> uint64_t  { return total; }
+    auto max() const -> uint64_t    { return maximum; }
+    auto mean() const -> double     { return total == 0 ? 0.0 : static_cast<double>(sum) / total; }
+    // in nanoseconds, the upper edge of the bucket holding the `quantile`th value
+    auto percentile(double quantile) const -> uint64_t;
+
+  private:
+    friend class Metrics;
+    std::array<uint64_t, bucket_count> buckets{};
+    uint64_t total    = 0;
+    uint64_t sum      = 0;
+    uint64_t maximum  = 0;
+  };
+
+  static void record(MessageType type, Stage stage, std::chrono::nanoseconds elapsed);
+  static void count(Counter counter, uint64_t amount = 1);
+
+  static auto histogram(MessageType type, Stage stage) -> Histogram;
+  static auto counter(Counter counter) -> uint64_t;
+
+  static auto stage_name(Stage stage) -> const char*;
+  static auto counter_name(Counter counter) -> const char*;
+  // a table of every histogram that saw a value, then the counters
+  static void dump(std::ostream& out);
+
+  static auto bucket_of(uint64_t nanoseconds) -> std::size_t;
+  static auto bucket_upper(std::size_t bucket) -> uint64_t;
+};
+
+#endif
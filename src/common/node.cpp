@@ -1,18 +1,87 @@
 #include "node.h"
+#include "common/affinity.h"
+#include "common/epoch.h"
+#include "common/metrics.h"
 #include "common/snowflake.h"
+#include "common/trace.h"
 #include "message.h"
 #include "ext/nlohmann/json.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <malloc.h>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <unistd.h>
+
+namespace {
+  // which of a shard's inboxes the calling thread pushes into, -1 for threads that are no known producer
+  thread_local int64_t producer_slot = -1;
+  thread_local int64_t shard_index = -1;
+  // the lane of the task the calling worker is running, -1 between tasks and for tasks on no lane
+  thread_local int64_t running_lane = -1;
+
+  constexpr int64_t reader_slot = 0;
+  constexpr int64_t timer_slot = 1;
+  constexpr int64_t first_shard_slot = 2;
+
+  // `index` tells workers apart, -1 for threads there is only one of
+  void pin_and_log(const char* thread, int64_t index, int cpu)
+  {
+    if (!Affinity::pin(cpu))
+      return;
+    const int node = Affinity::numa_node_of(cpu);
+    if (index >= 0)
+      std::clog << "[📌][SYS] " << thread << ' ' << index << " pinned to cpu " << cpu << ", numa node " << node << '\n';
+    else
+      std::clog << "[📌][SYS] " << thread << " pinned to cpu " << cpu << ", numa node " << node << '\n';
+  }
+
+  // a spinning core backs off for a moment, leaving its pipeline to a hyperthread sibling
+  inline void cpu_relax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+}
 
 
 Node::Node(int num_workers)
   : state(STARTING)
+  , checkpoint_every(0)
+  , generation(0)
+  , checkpointed_generation(0)
+  , logged_since_checkpoint(0)
+  , checkpointing(false)
+  , outstanding_rpcs(0)
+  , runnable_tasks(0)
+  , queued_tasks(0)
+  , queued_requests(0)
+  , queue_limit(0)
+  , overload_policy(REJECT)
+  , shard_ring_capacity(0)
+  , next_shard(0)
+  , queued_timers(0)
+  , started_at(std::chrono::steady_clock::now())
+  , transport(std::make_unique<StdioTransport>())
+  , timers_in_transport(false)
+  , random_engine(std::random_device()())
+  , idle_strategy(PARK)
+  , idle_spin(0)
   , worker_count(num_workers)
 {
   register_handler(INIT_REQ, std::bind(&Node::handle_init, this, std::placeholders::_1));
+  register_handler(STATS_REQ, std::bind(&Node::handle_stats, this, std::placeholders::_1));
 }
 
 
@@ -24,22 +93,222 @@ void Node::init(std::vector<std::string>&& all_nodes, int self_index)
   }
   // TODO: add middleware to be pissy about unrecognized node id references
   all_node_ids = std::move(all_nodes);
+  // replayed before the id is published, dispatch drops everything but init until then
+  if (!wal_directory.empty())
+    recover(all_node_ids.at(self_index));
   self_node_id = all_node_ids.at(self_index);
   std::clog << "[✅][SYS] node initialized\n";
 }
 
 
+void Node::enable_wal(std::string directory, uint64_t checkpoint_every)
+{
+  wal_directory = std::move(directory);
+  this->checkpoint_every = checkpoint_every;
+}
+
+
+void Node::persist(std::string_view stream, const json& record, Message response)
+{
+  persist(stream, record, [this, response = std::move(response)] {
+    if (response.type != INVALID)
+      write_message(response);
+  });
+}
+
+
+void Node::persist(std::string_view stream, const json& record, task_fn on_durable)
+{
+  if (nullptr == wal) {
+    on_durable();
+    return;
+  }
+  json framed = { { "stream", stream }, { "record", record } };
+  wal->append(framed.dump(), std::move(on_durable));
+  if (checkpoint_every == 0 || checkpointers.empty() || ++logged_since_checkpoint < checkpoint_every)
+    return;
+  if (!checkpointing.exchange(true))
+    schedule(std::chrono::microseconds::zero(), std::bind(&Node::checkpoint, this));
+}
+
+
+void Node::register_replay(std::string_view stream, replay_fn replay)
+{
+  replay_handlers.insert_or_assign(std::string(stream), std::move(replay));
+}
+
+
+void Node::register_checkpoint(std::string_view stream, dump_fn dump, restore_fn restore)
+{
+  checkpointers.insert_or_assign(std::string(stream), Checkpointer{ std::move(dump), std::move(restore) });
+}
+
+
+void Node::recover(std::string_view self_id)
+{
+  std::error_code error;
+  std::filesystem::create_directories(wal_directory, error);
+  wal_prefix = wal_directory + "/" + std::string(self_id);
+
+  // the manifest names the generation whose snapshots are complete, its log and any later one hold the rest
+  if (std::ifstream manifest(wal_prefix + ".checkpoint"); manifest) {
+    uint64_t checkpointed = 0;
+    manifest >> checkpointed;
+    generation = checkpointed;
+    checkpointed_generation = checkpointed;
+  }
+  for (auto& [stream, checkpointer] : checkpointers) {
+    std::shared_ptr<const SnapshotFile> snapshot = SnapshotFile::open(snapshot_path(generation, stream));
+    if (nullptr != snapshot)
+      std::clog << "[📸][WAL] mapped " << snapshot->size() << " entries of '" << stream << "' from generation " << generation << '\n';
+    checkpointer.restore(std::move(snapshot));
+  }
+
+  const auto replay = [this](std::string_view raw) {
+    json framed = json::parse(raw, nullptr, false);
+    if (framed.is_discarded() || !framed.contains("stream") || !framed["stream"].is_string() || !framed.contains("record")) {
+      std::clog << "[❓][WAL] skipping unreadable record\n";
+      return;
+    }
+    auto handler = replay_handlers.find(framed["stream"].get<std::string>());
+    if (handler != replay_handlers.end())
+      handler->second(framed["record"]);
+  };
+  // a crash between rotating the log and writing the manifest leaves the next generation's log behind
+  std::unique_ptr<WriteAheadLog> log;
+  for (uint64_t gen = generation; gen == generation || std::filesystem::exists(wal_path(gen), error); ++gen) {
+    log = std::make_unique<WriteAheadLog>();
+    if (!log->open(wal_path(gen))) {
+      std::clog << "[❌][WAL] running without durability\n";
+      return;
+    }
+    log->replay(replay);
+    generation = gen;
+  }
+  log->start();
+  wal = std::move(log);
+}
+
+
+void Node::checkpoint()
+{
+  const uint64_t next = generation + 1;
+  logged_since_checkpoint = 0;
+  // everything logged from here on lands in the next generation's log. state dumped below may already contain
+  // some of it, replay is idempotent so applying it twice is harmless.
+  // until the manifest moves on, recovery replays all logs from its generation on top of its snapshots
+  if (!wal->rotate(wal_path(next))) {
+    checkpointing = false;
+    return;
+  }
+  generation = next;
+  if (!write_checkpoint(next)) {
+    checkpointing = false;
+    return;
+  }
+  // any generation below the manifest's is superseded, not only the one before it
+  std::error_code error;
+  for (uint64_t gen = checkpointed_generation; gen < next; ++gen) {
+    std::filesystem::remove(wal_path(gen), error);
+    for (const auto& [stream, checkpointer] : checkpointers)
+      std::filesystem::remove(snapshot_path(gen, stream), error);
+  }
+  std::clog << "[📸][WAL] checkpointed generation " << next << '\n';
+  checkpointed_generation = next;
+  checkpointing = false;
+}
+
+
+auto Node::write_checkpoint(uint64_t next) -> bool
+{
+  for (const auto& [stream, checkpointer] : checkpointers) {
+    SnapshotWriter writer;
+    if (!writer.open(snapshot_path(next, stream)))
+      return false;
+    checkpointer.dump(writer);
+    if (!writer.finish())
+      return false;
+  }
+  const std::string manifest = wal_prefix + ".checkpoint";
+  const std::string contents = std::to_string(next) + "\n";
+  const int fd = ::open((manifest + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  // the old generation is deleted once the manifest is in place, it has to be on disk by then
+  const bool written = fd >= 0 && ::write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size())
+    && ::fsync(fd) == 0;
+  if (fd >= 0)
+    ::close(fd);
+  if (!written || std::rename((manifest + ".tmp").c_str(), manifest.c_str()) != 0) {
+    std::clog << "[❌][WAL] cannot write checkpoint manifest '" << manifest << "': " << std::strerror(errno) << '\n';
+    return false;
+  }
+  return true;
+}
+
+
+auto Node::wal_path(uint64_t gen) const -> std::string
+{
+  return wal_prefix + "." + std::to_string(gen) + ".wal";
+}
+
+
+auto Node::snapshot_path(uint64_t gen, std::string_view stream) const -> std::string
+{
+  return wal_prefix + "." + std::to_string(gen) + "." + std::string(stream) + ".snap";
+}
+
+
 void Node::run()
 {
+  // blocked before any thread is spawned so that only the signal thread ever takes it
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  std::thread signal_thread(std::bind(&Node::signal_loop, this));
+
+  // a transport running its own event loop waits on the timers as well
+  timers_in_transport = transport->drive_timers(std::bind(&Node::next_timer, this), std::bind(&Node::fire_timers, this));
+  producer_slot = reader_slot;
+  if (reader_cpu.has_value())
+    pin_and_log("reader", -1, reader_cpu.value());
+  // shards always get a core each, round-robin over the allowed ones unless placed. picked here, a worker
+  // must not allocate before it is pinned
+  if (worker_cpus.empty() && shard_ring_capacity > 0 && worker_count > 0)
+    worker_cpus = Affinity::allowed_cpus();
+
+  if (shard_ring_capacity > 0 && worker_count > 0) {
+    const std::size_t producers = first_shard_slot + worker_count;
+    for (int idx = 0; idx < worker_count; ++idx) {
+      auto shard = std::make_unique<Shard>();
+      for (std::size_t producer = 0; producer < producers; ++producer)
+        shard->inboxes.emplace_back(std::make_unique<Inbox>(shard_ring_capacity));
+      shards.emplace_back(std::move(shard));
+    }
+    if (queue_limit > 0 && overload_policy != REJECT)
+      std::clog << "[⚠️][SYS] shards only support rejecting at the queue limit\n";
+    std::clog << "[✅][SYS] running " << worker_count << " shards\n";
+  }
   std::vector<std::thread> worker_pool(worker_count);
-  for (std::thread& worker : worker_pool)
-    worker = std::thread(std::bind(&Node::worker_loop, this));
+  for (std::size_t idx = 0; idx < worker_pool.size(); ++idx) {
+    worker_pool[idx] = shards.empty() ? std::thread(std::bind(&Node::worker_loop, this, idx))
+      : std::thread(std::bind(&Node::shard_loop, this, idx));
+  }
+
+  std::thread timer_thread;
+  if (!timers_in_transport)
+    timer_thread = std::thread(std::bind(&Node::timer_loop, this));
 
   state = RUNNING;
   while (RUNNING == state) {
+    // sampled up front, a traced 'read' includes however long the transport kept us waiting
+    Trace::Context context(Trace::sample());
     std::string buf;
-    std::getline(std::cin, buf);
-    if (buf.empty()) {
+    bool open;
+    {
+      Trace::Span span("read");
+      open = transport->read(buf);
+    }
+    if (!open || buf.empty()) {
       std::clog << "[🛬][SYS] received empty line, shutting node down...\n";
       state = SHUTDOWN;
       break;
@@ -49,8 +318,18 @@ void Node::run()
   }
 
   std::clog << "[⏰][SYS] waiting for workers...\n";
+  {
+    std::unique_lock lock(mutex_timers);
+    timer_condition.notify_all();
+  }
+  if (timer_thread.joinable())
+    timer_thread.join();
+  pthread_kill(signal_thread.native_handle(), SIGUSR1);
+  signal_thread.join();
   int join_count = 0;
   queue_condition.notify_all();
+  for (const std::unique_ptr<Shard>& shard : shards)
+    wake_shard(*shard);
   while (join_count != worker_count) {
     for (auto& worker : worker_pool) {
       if (worker.joinable()) {
@@ -59,6 +338,12 @@ void Node::run()
       }
     }
   }
+  // workers may persist until they are joined, whatever they queued is committed before the log closes
+  if (nullptr != wal)
+    wal->stop();
+  transport->close();
+  Metrics::dump(std::clog);
+  Trace::flush();
   std::clog << "[👺][SYS] clean node shutdown finished\n";
 }
 
@@ -67,6 +352,14 @@ void Node::stop()
 {
   state = Node::SHUTDOWN;
   queue_condition.notify_all();
+  for (const std::unique_ptr<Shard>& shard : shards)
+    wake_shard(*shard);
+  {
+    std::unique_lock lock(mutex_thread_tasks);
+    space_condition.notify_all();
+  }
+  std::unique_lock lock(mutex_timers);
+  timer_condition.notify_all();
 }
 
 
@@ -82,6 +375,196 @@ void Node::register_handler(MessageType type, callback_fn handler)
 }
 
 
+void Node::enable_lanes(std::size_t count)
+{
+  lanes = std::vector<Lane>(count);
+}
+
+
+void Node::set_lane_key(MessageType type, lane_key_fn key)
+{
+  lane_keys.insert_or_assign(type, std::move(key));
+}
+
+
+void Node::enable_shards(std::size_t ring_capacity)
+{
+  shard_ring_capacity = std::max<std::size_t>(ring_capacity, 2);
+}
+
+
+void Node::set_placement(std::optional<int> reader_cpu, std::vector<int> worker_cpus)
+{
+  this->reader_cpu = reader_cpu;
+  this->worker_cpus = std::move(worker_cpus);
+}
+
+
+void Node::set_idle_strategy(IdleStrategy strategy, std::chrono::microseconds spin)
+{
+  idle_strategy = strategy;
+  idle_spin = spin;
+}
+
+
+auto Node::current_shard() -> int64_t
+{
+  return shard_index;
+}
+
+
+auto Node::origin_lane() const -> int64_t
+{
+  return shards.empty() ? running_lane : shard_index;
+}
+
+
+void Node::post(std::size_t shard, task_fn task)
+{
+  enqueue_task(std::make_shared<Message>(), [task = std::move(task)](const Message&) {
+    task();
+    return Message();
+  }, false, shards.empty() ? -1 : static_cast<int64_t>(shard % shards.size()));
+}
+
+
+void Node::send(const Message& msg)
+{
+  write_message(msg);
+}
+
+
+void Node::rpc(const Message& msg, reply_fn on_reply, std::chrono::milliseconds timeout)
+{
+  if (!msg.id.is_valid()) {
+    std::clog << "[❌][RPC] cannot await a reply to a message without 'msg_id'\n";
+    return;
+  }
+  pending_rpcs.insert(msg.id, PendingRpc{ std::move(on_reply), origin_lane() });
+  ++outstanding_rpcs;
+
+  if (timeout > std::chrono::milliseconds::zero()) {
+    schedule(timeout, [this, id = msg.id, timed_out = msg.create_error(ERR_TIMEOUT, "rpc timed out")] {
+      std::optional<PendingRpc> pending = pending_rpcs.take(id);
+      if (!pending.has_value())
+        return;
+      --outstanding_rpcs;
+      std::clog << "[⏰][RPC] no reply from '" << timed_out.from << "' in time\n";
+      pending->on_reply(timed_out);
+    });
+  }
+  write_message(msg);
+}
+
+
+void Node::schedule(std::chrono::microseconds delay, task_fn task)
+{
+  std::unique_lock lock(mutex_timers);
+  const auto due = now() + delay;
+  timers.push({ due, std::move(task), origin_lane() });
+  ++queued_timers;
+  lock.unlock();
+  if (timers_in_transport)
+    transport->timer_scheduled(due);
+  else
+    timer_condition.notify_one();
+}
+
+
+void Node::set_clock(clock_fn clock)
+{
+  this->clock = std::move(clock);
+}
+
+
+auto Node::now() const -> std::chrono::steady_clock::time_point
+{
+  return clock ? clock() : std::chrono::steady_clock::now();
+}
+
+
+void Node::set_transport(std::unique_ptr<Transport> transport)
+{
+  this->transport = std::move(transport);
+}
+
+
+void Node::set_queue_limit(std::size_t limit, OverloadPolicy policy)
+{
+  queue_limit = limit;
+  overload_policy = policy;
+}
+
+
+void Node::seed(uint64_t seed)
+{
+  std::unique_lock lock(mutex_random);
+  random_engine.seed(seed);
+}
+
+
+auto Node::random() -> uint64_t
+{
+  std::unique_lock lock(mutex_random);
+  return random_engine();
+}
+
+
+auto Node::next_timer() -> std::optional<std::chrono::steady_clock::time_point>
+{
+  std::unique_lock lock(mutex_timers);
+  if (timers.empty())
+    return std::nullopt;
+  return timers.top().due;
+}
+
+
+void Node::fire_timers()
+{
+  const auto current = now();
+  std::unique_lock lock(mutex_timers);
+  while (!timers.empty() && timers.top().due <= current) {
+    task_fn task = timers.top().task;
+    const int64_t lane = timers.top().lane;
+    timers.pop();
+    --queued_timers;
+    lock.unlock();
+    enqueue_task(std::make_shared<Message>(), [task = std::move(task)](const Message&) {
+      task();
+      return Message();
+    }, false, lane);
+    lock.lock();
+  }
+}
+
+
+auto Node::run_pending() -> std::size_t
+{
+  std::size_t ran = 0;
+  while (true) {
+    std::unique_lock queue_lock(mutex_thread_tasks);
+    if (task_queue.empty())
+      return ran;
+    ThreadTask task = take_task();
+    queue_lock.unlock();
+    run_task(task);
+    finish_task(task);
+    ++ran;
+  }
+}
+
+
+void Node::register_local_service(std::string_view name, local_service_fn service)
+{
+  if (RUNNING == state) {
+    std::clog << "[❌][SYS] local services have to be registered before the node runs\n";
+    return;
+  }
+  local_services.insert_or_assign(std::string(name), std::move(service));
+  std::clog << "[✅][SYS] messages to '" << name << "' are handled in-process\n";
+}
+
+
 auto Node::handle_init(const Message& msg) -> Message
 {
   std::vector<std::string> node_ids;
@@ -108,61 +591,560 @@ auto Node::handle_init(const Message& msg) -> Message
 }
 
 
+auto Node::handle_stats(const Message& msg) -> Message
+{
+  Message response = msg.create_response();
+  const auto uptime = std::chrono::steady_clock::now() - started_at;
+  const double uptime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(uptime).count();
+  response.body["uptime_us"] = std::chrono::duration_cast<std::chrono::microseconds>(uptime).count();
+
+  json& counters = response.body["counters"] = json::object();
+  for (int idx = 0; idx < Metrics::COUNTER_COUNT; ++idx)
+    counters[Metrics::counter_name(static_cast<Metrics::Counter>(idx))] = Metrics::counter(static_cast<Metrics::Counter>(idx));
+
+  json& latencies = response.body["latency_us"] = json::object();
+  for (int type = 0; type < MESSAGE_TYPE_COUNT; ++type) {
+    for (int stage = 0; stage < Metrics::STAGE_COUNT; ++stage) {
+      const Metrics::Histogram histogram = Metrics::histogram(static_cast<MessageType>(type), static_cast<Metrics::Stage>(stage));
+      if (histogram.count() == 0)
+        continue;
+      const std::string name(type == INVALID ? "(task)" : message_type_to_string(static_cast<MessageType>(type)));
+      latencies[name][Metrics::stage_name(static_cast<Metrics::Stage>(stage))] = {
+        { "count",  histogram.count() },
+        { "mean",   histogram.mean() / 1e3 },
+        { "p50",    histogram.percentile(0.5) / 1e3 },
+        { "p90",    histogram.percentile(0.9) / 1e3 },
+        { "p99",    histogram.percentile(0.99) / 1e3 },
+        { "p999",   histogram.percentile(0.999) / 1e3 },
+        { "max",    histogram.max() / 1e3 },
+      };
+    }
+  }
+
+  response.body["queues"] = {
+    { "tasks",        queued_tasks.load(std::memory_order_relaxed) },
+    { "requests",     queued_requests.load(std::memory_order_relaxed) },
+    { "limit",        queue_limit },
+    { "timers",       queued_timers.load(std::memory_order_relaxed) },
+    { "pending_rpcs", outstanding_rpcs.load(std::memory_order_relaxed) },
+    { "retired",      Epoch::pending() },
+  };
+  const double busy_ns = Metrics::counter(Metrics::BUSY_NANOSECONDS);
+  response.body["workers"] = {
+    { "count",        worker_count },
+    { "lanes",        lanes.size() },
+    { "shards",       shards.size() },
+    { "utilization",  uptime_ns > 0 ? busy_ns / (uptime_ns * worker_count) : 0.0 },
+  };
+  if (nullptr != wal) {
+    const WriteAheadLog::Stats& stats = wal->stats();
+    response.body["wal"] = {
+      { "records",    stats.records.load(std::memory_order_relaxed) },
+      { "batches",    stats.batches.load(std::memory_order_relaxed) },
+      { "bytes",      stats.bytes.load(std::memory_order_relaxed) },
+      { "generation", generation.load(std::memory_order_relaxed) },
+    };
+  }
+  // glibc's own counters, it briefly locks each arena to sum them
+  const struct mallinfo2 heap = ::mallinfo2();
+  response.body["allocator"] = {
+    { "arena_bytes",    heap.arena },
+    { "mmapped_bytes",  heap.hblkhd },
+    { "in_use_bytes",   heap.uordblks },
+    { "free_bytes",     heap.fordblks },
+  };
+  return response;
+}
+
+
 void Node::dispatch_message(std::string&& raw)
 {
-  std::optional<Message> msg = Message::parse(raw);
+  Metrics::count(Metrics::MESSAGES_IN);
+  std::optional<Message> msg = [&raw] {
+    Trace::Span span("parse");
+    return Message::parse(raw);
+  }();
   if (!msg.has_value()) {
+    Metrics::count(Metrics::PARSE_FAILURES);
     std::clog << "[❓][MSG] failed to parse: '" << raw << "'\n";
     return;
   }
   std::clog << "[✅][MSG] parsed: '" << msg->as_json() << "'\n";
-  if (self_node_id.empty() && msg->type != INIT_REQ) {
+  dispatch(std::move(msg.value()));
+}
+
+
+void Node::deliver(Message&& msg)
+{
+  Metrics::count(Metrics::MESSAGES_IN);
+  dispatch(std::move(msg));
+}
+
+
+void Node::dispatch(Message&& msg)
+{
+  if (self_node_id.empty() && msg.type != INIT_REQ) {
+    Metrics::count(Metrics::DROPPED);
     std::clog << "[⚠️][MSG] received non-init request before node has been initialized, ignoring\n";
     return;
   }
 
-  auto found = handler_map.find(msg->type);
+  if (msg.reply_id.is_valid()) {
+    if (std::optional<PendingRpc> pending = pending_rpcs.take(msg.reply_id); pending.has_value()) {
+      --outstanding_rpcs;
+      enqueue_task(std::make_shared<Message>(std::move(msg)), [on_reply = std::move(pending->on_reply)](const Message& reply) {
+        on_reply(reply);
+        return Message();
+      }, false, pending->lane);
+      return;
+    }
+  }
+
+  auto found = handler_map.find(msg.type);
   if (found == handler_map.end()) {
-    std::clog << "[❓][MSG] no handler for message type: '" << message_type_to_string(msg->type) << "'\n";
+    Metrics::count(Metrics::DROPPED);
+    std::clog << "[❓][MSG] no handler for message type: '" << message_type_to_string(msg.type) << "'\n";
     // TODO: respond with unrecognized RPC error msg?
     return;
   }
+  callback_fn invoke = found->second;
+  // with shards, the lane is the shard
+  const std::size_t ways = shards.empty() ? lanes.size() : shards.size();
+  int64_t lane = -1;
+  if (ways > 0) {
+    auto key = lane_keys.find(msg.type);
+    lane = (key != lane_keys.end() ? key->second(msg) : std::hash<std::string>()(msg.from)) % ways;
+  }
+  enqueue_task(std::make_shared<Message>(std::move(msg)), std::move(invoke), true, lane);
+}
+
 
+void Node::enqueue_task(std::shared_ptr<Message>&& msg, callback_fn&& invoke, bool request, int64_t lane)
+{
+  Trace::Span span("enqueue", msg->type);
   ThreadTask new_task;
-  new_task.message = std::make_shared<Message>(std::move(msg.value()));
-  new_task.invoke = found->second;
+  new_task.trace = Trace::current();
+  new_task.message = std::move(msg);
+  new_task.invoke = std::move(invoke);
+  new_task.enqueued = std::chrono::steady_clock::now();
+  new_task.request = request;
+  new_task.lane = lane;
+
+  if (!shards.empty()) {
+    if (request && queue_limit > 0 && queued_requests.load(std::memory_order_relaxed) >= static_cast<int64_t>(queue_limit)) {
+      reject(*new_task.message);
+      return;
+    }
+    ++queued_tasks;
+    if (request)
+      ++queued_requests;
+    route_to_shard(std::move(new_task));
+    return;
+  }
 
   // do i move this to a scope? i am deeply schizoid-paranoid about the compiler's interpretation of this
   std::unique_lock lock(mutex_thread_tasks);
-  task_queue.emplace(std::move(new_task));
+  std::shared_ptr<Message> shed;
+  if (request && queue_limit > 0 && queued_requests.load(std::memory_order_relaxed) >= static_cast<int64_t>(queue_limit)) {
+    switch (overload_policy) {
+      case BLOCK: {
+        const auto blocked = std::chrono::steady_clock::now();
+        space_condition.wait(lock, [this] {
+          return state == SHUTDOWN || queued_requests.load(std::memory_order_relaxed) < static_cast<int64_t>(queue_limit);
+        });
+        Metrics::count(Metrics::BACKPRESSURE_NANOSECONDS,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - blocked).count());
+        break;
+      }
+      case SHED_OLDEST:
+        shed = shed_oldest();
+        break;
+      case REJECT:
+        lock.unlock();
+        reject(*new_task.message);
+        return;
+    }
+  }
+  ++queued_tasks;
+  if (request)
+    ++queued_requests;
+  // a task whose lane is busy runs once the ones before it are done
+  const bool runnable = lane < 0 || !lanes[lane].busy;
+  if (runnable) {
+    if (lane >= 0)
+      lanes[lane].busy = true;
+    task_queue.emplace_back(std::move(new_task));
+    ++runnable_tasks;
+  } else {
+    lanes[lane].backlog.emplace_back(std::move(new_task));
+  }
   lock.unlock();
-  queue_condition.notify_one();
+  if (runnable)
+    queue_condition.notify_one();
+  if (nullptr != shed) {
+    Metrics::count(Metrics::SHED);
+    std::clog << "[⚠️][MSG] queue full, shed the oldest waiting '" << message_type_to_string(shed->type) << "'\n";
+  }
+}
+
+
+void Node::write_message(const Message& msg)
+{
+  if (!local_services.empty()) {
+    if (auto service = local_services.find(msg.to); service != local_services.end()) {
+      service->second(msg);
+      return;
+    }
+  }
+  const auto started = std::chrono::steady_clock::now();
+  transport->send(msg);
+  std::clog << "[" << std::this_thread::get_id() << "][✉️][JOB] sent '" << message_type_to_string(msg.type) << "' to " << msg.to << '\n';
+  Metrics::count(Metrics::MESSAGES_OUT);
+  Metrics::record(msg.type, Metrics::WRITE_OUT, std::chrono::steady_clock::now() - started);
 }
 
 
-void Node::worker_loop()
+void Node::place_worker(std::size_t index)
 {
+  // first thing on the new thread: glibc hands it a malloc arena on its first allocation, which then
+  // comes from the node it is pinned to
+  if (!worker_cpus.empty())
+    pin_and_log(shards.empty() ? "worker" : "shard", index, worker_cpus[index % worker_cpus.size()]);
+}
+
+
+void Node::worker_loop(std::size_t index)
+{
+  place_worker(index);
+  Epoch::online();
+  IdleState idle;
   while (true) {
+    // nothing the previous task read out of a shared structure is referenced anymore
+    Epoch::quiescent();
+    bool park = idle_strategy == PARK;
+    if (idle_strategy != PARK && runnable_tasks.load(std::memory_order_relaxed) == 0 && state != SHUTDOWN) {
+      // a spinning worker holds no references either, it goes offline just like a parked one
+      Epoch::offline();
+      park = !spin_for_work(idle, [this]{ return runnable_tasks.load(std::memory_order_relaxed) > 0; });
+      Epoch::online();
+    }
     std::unique_lock queue_lock(mutex_thread_tasks);
-    queue_condition.wait(queue_lock, [this]{ return state == SHUTDOWN || !task_queue.empty(); });
+    if (state != SHUTDOWN && task_queue.empty()) {
+      // another worker got there first, back to spinning
+      if (!park)
+        continue;
+      // a parked worker must not hold back reclamation for everyone else
+      Epoch::offline();
+      queue_condition.wait(queue_lock, [this]{ return state == SHUTDOWN || !task_queue.empty(); });
+      Epoch::online();
+    }
     if (state == SHUTDOWN && task_queue.empty())
-      return;
-    ThreadTask task = std::move(task_queue.front());
-    task_queue.pop();
+      break;
+    ThreadTask task = take_task();
     queue_lock.unlock();
+    end_idle(idle);
+    run_task(task);
+    finish_task(task);
+  }
+  Epoch::offline();
+}
+
+
+template<typename ready_fn>
+auto Node::spin_for_work(IdleState& idle, ready_fn ready) const -> bool
+{
+  const auto started = std::chrono::steady_clock::now();
+  if (!idle.waiting) {
+    idle.since = started;
+    idle.waiting = true;
+  }
+  // spin-then-park spins about twice as long as work took to show up lately, not at all if that exceeds the budget
+  std::chrono::nanoseconds budget = idle_spin;
+  if (idle_strategy == SPIN_PARK)
+    budget = idle.average_gap > idle_spin ? std::chrono::nanoseconds::zero() : std::min(2 * idle.average_gap, idle_spin);
+  const auto spin_until = started + budget;
+  bool yielding = false;
+  for (uint32_t round = 1; ; ++round) {
+    if (ready() || state == SHUTDOWN)
+      return true;
+    if (yielding) {
+      std::this_thread::yield();
+      continue;
+    }
+    // the clock costs more than a poll, it is only read every 64 of them
+    if (round % 64 != 0 || idle_strategy == BUSY_SPIN || std::chrono::steady_clock::now() < spin_until) {
+      cpu_relax();
+      continue;
+    }
+    if (idle_strategy == SPIN_PARK)
+      return false;
+    yielding = true;
+  }
+}
+
+
+void Node::end_idle(IdleState& idle) const
+{
+  if (!idle.waiting)
+    return;
+  idle.waiting = false;
+  // a long quiet spell counts as merely too long to spin through, so the next burst is picked up again within a few gaps
+  const auto gap = std::min<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - idle.since, 2 * idle_spin);
+  idle.average_gap += (gap - idle.average_gap) / 8;
+}
+
+
+void Node::reject(const Message& msg)
+{
+  Metrics::count(Metrics::REJECTED);
+  std::clog << "[⚠️][MSG] queue full, rejecting '" << message_type_to_string(msg.type) << "'\n";
+  if (msg.id.is_valid())
+    write_message(msg.create_error(ERR_TEMPORARILY_UNAVAILABLE, "node overloaded, queue full"));
+}
+
+
+auto Node::shed_oldest() -> std::shared_ptr<Message>
+{
+  // candidates are the first request in the shared queue and the first request in each lane's backlog. a backlog
+  // may start with a timer or rpc reply of its lane, with requests waiting behind it
+  const auto is_request = [](const ThreadTask& task) { return task.request; };
+  auto queued = std::find_if(task_queue.begin(), task_queue.end(), is_request);
+  Lane* oldest_lane = nullptr;
+  std::deque<ThreadTask>::iterator backlogged;
+  for (Lane& lane : lanes) {
+    auto found = std::find_if(lane.backlog.begin(), lane.backlog.end(), is_request);
+    if (found == lane.backlog.end())
+      continue;
+    if ((oldest_lane == nullptr || found->enqueued < backlogged->enqueued)
+        && (queued == task_queue.end() || found->enqueued < queued->enqueued)) {
+      oldest_lane = &lane;
+      backlogged = found;
+    }
+  }
+  std::shared_ptr<Message> shed;
+  if (oldest_lane != nullptr) {
+    shed = std::move(backlogged->message);
+    oldest_lane->backlog.erase(backlogged);
+  } else if (queued != task_queue.end()) {
+    shed = std::move(queued->message);
+    const int64_t lane = queued->lane;
+    task_queue.erase(queued);
+    --runnable_tasks;
+    if (lane >= 0)
+      advance_lane(lane);
+  } else {
+    // no request is waiting, the new one goes over the limit rather than anything else being dropped
+    return nullptr;
+  }
+  --queued_tasks;
+  --queued_requests;
+  return shed;
+}
+
+
+void Node::advance_lane(int64_t lane)
+{
+  Lane& next = lanes[lane];
+  if (next.backlog.empty()) {
+    next.busy = false;
+    return;
+  }
+  task_queue.emplace_back(std::move(next.backlog.front()));
+  next.backlog.pop_front();
+  ++runnable_tasks;
+  queue_condition.notify_one();
+}
+
+
+void Node::finish_task(const ThreadTask& task)
+{
+  if (task.lane < 0)
+    return;
+  std::unique_lock lock(mutex_thread_tasks);
+  advance_lane(task.lane);
+}
+
+
+auto Node::take_task() -> ThreadTask
+{
+  ThreadTask task = std::move(task_queue.front());
+  task_queue.pop_front();
+  --runnable_tasks;
+  --queued_tasks;
+  if (task.request) {
+    --queued_requests;
+    if (queue_limit > 0 && overload_policy == BLOCK)
+      space_condition.notify_one();
+  }
+  return task;
+}
+
 
-    std::clog << "[" << std::this_thread::get_id() << "][⚒️][JOB] invoking '" << message_type_to_string(task.message->type) 
-              << "' handler on message " << task.message->as_json() << '\n';
-    Message response = task.invoke(*task.message);
-    if (response.type != INVALID) {
-      std::unique_lock lock(mutex_write_response);
-      std::clog << "[" << std::this_thread::get_id() << "][✉️][JOB] response begin:\n";
-      std::cout << response.as_json() << std::endl;
-      std::clog << "[" << std::this_thread::get_id() << "][✉️][JOB] === response end\n";
-      lock.unlock();
-      std::clog << "[" << std::this_thread::get_id() << "][⚒️][JOB] finished handling '" 
-        << message_type_to_string(task.message->type) << "'\n";
+void Node::shard_loop(std::size_t index)
+{
+  place_worker(index);
+  Epoch::online();
+  producer_slot = first_shard_slot + index;
+  shard_index = index;
+  Shard& shard = *shards[index];
+  ThreadTask task;
+  IdleState idle;
+  while (true) {
+    Epoch::quiescent();
+    if (take_from_shard(shard, task)) {
+      end_idle(idle);
+      --queued_tasks;
+      if (task.request)
+        --queued_requests;
+      run_task(task);
+      continue;
+    }
+    if (state == SHUTDOWN)
+      break;
+    // a spinning shard is not `parked`, producers push without waking it
+    if (idle_strategy != PARK) {
+      Epoch::offline();
+      const bool ready = spin_for_work(idle, [this, &shard]{ return !shard_idle(shard); });
+      Epoch::online();
+      if (ready)
+        continue;
+    }
+    // whoever pushes after `parked` is set sees it and wakes us, whoever pushed before is caught by the re-check
+    const uint32_t seen = shard.wakeups.load();
+    shard.parked.store(true);
+    if (shard_idle(shard) && state != SHUTDOWN) {
+      Epoch::offline();
+      shard.wakeups.wait(seen);
+      Epoch::online();
+    }
+    shard.parked.store(false, std::memory_order_relaxed);
+  }
+  Epoch::offline();
+}
+
+
+void Node::route_to_shard(ThreadTask&& task)
+{
+  int64_t target = task.lane;
+  if (target < 0)
+    target = shard_index >= 0 ? shard_index : next_shard.fetch_add(1, std::memory_order_relaxed) % shards.size();
+  Shard& shard = *shards[target];
+  // threads that are no known producer share the reader's overflow, which takes a lock
+  Inbox& inbox = *shard.inboxes[producer_slot >= 0 ? producer_slot : reader_slot];
+  if (producer_slot < 0 || inbox.overflowing.load(std::memory_order_acquire) || !inbox.ring.try_push(std::move(task))) {
+    std::unique_lock lock(inbox.mutex_overflow);
+    inbox.overflow.emplace_back(std::move(task));
+    inbox.overflowing.store(true, std::memory_order_release);
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (shard.parked.load(std::memory_order_relaxed))
+    wake_shard(shard);
+}
+
+
+auto Node::take_from_shard(Shard& shard, ThreadTask& task) -> bool
+{
+  // round robin over the producers, so a busy reader does not starve timers or other shards
+  const std::size_t count = shard.inboxes.size();
+  for (std::size_t step = 0; step < count; ++step) {
+    Inbox& inbox = *shard.inboxes[shard.next_inbox];
+    shard.next_inbox = (shard.next_inbox + 1) % count;
+    if (inbox.ring.try_pop(task))
+      return true;
+    if (!inbox.overflowing.load(std::memory_order_acquire))
+      continue;
+    std::unique_lock lock(inbox.mutex_overflow);
+    // the ring may have been refilled before the producer switched over, it goes first
+    if (inbox.ring.try_pop(task))
+      return true;
+    task = std::move(inbox.overflow.front());
+    inbox.overflow.pop_front();
+    if (inbox.overflow.empty())
+      inbox.overflowing.store(false, std::memory_order_release);
+    return true;
+  }
+  return false;
+}
+
+
+auto Node::shard_idle(Shard& shard) const -> bool
+{
+  for (const std::unique_ptr<Inbox>& inbox : shard.inboxes) {
+    if (!inbox->ring.empty() || inbox->overflowing.load(std::memory_order_seq_cst))
+      return false;
+  }
+  return true;
+}
+
+
+void Node::wake_shard(Shard& shard)
+{
+  shard.wakeups.fetch_add(1);
+  shard.wakeups.notify_all();
+}
+
+
+void Node::run_task(ThreadTask& task)
+{
+  const auto started = std::chrono::steady_clock::now();
+  Metrics::record(task.message->type, Metrics::QUEUE_WAIT, started - task.enqueued);
+  Trace::Context context(task.trace);
+  Trace::record("queued", task.trace, task.message->type, Trace::at(task.enqueued), Trace::at(started));
+  std::clog << "[" << std::this_thread::get_id() << "][⚒️][JOB] invoking '" << message_type_to_string(task.message->type) 
+            << "' handler on message " << task.message->as_json() << '\n';
+  running_lane = task.lane;
+  Message response = [&task] {
+    Trace::Span span("handle", task.message->type);
+    return task.invoke(*task.message);
+  }();
+  running_lane = -1;
+  const auto finished = std::chrono::steady_clock::now();
+  Metrics::record(task.message->type, Metrics::HANDLER, finished - started);
+  Metrics::count(Metrics::BUSY_NANOSECONDS, std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count());
+  if (response.type != INVALID) {
+    write_message(response);
+    std::clog << "[" << std::this_thread::get_id() << "][⚒️][JOB] finished handling '" 
+      << message_type_to_string(task.message->type) << "'\n";
+  }
+}
+
+void Node::signal_loop()
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  int received = 0;
+  while (sigwait(&signals, &received) == 0 && state != SHUTDOWN)
+    Metrics::dump(std::clog);
+}
+
+void Node::timer_loop()
+{
+  // the only thread pushing into the shards' timer inboxes. with the timers in the transport the reader fires them
+  producer_slot = timer_slot;
+  if (reader_cpu.has_value())
+    pin_and_log("timer thread", -1, reader_cpu.value());
+  std::unique_lock lock(mutex_timers);
+  while (state != SHUTDOWN) {
+    if (timers.empty()) {
+      timer_condition.wait(lock, [this]{ return state == SHUTDOWN || !timers.empty(); });
+      continue;
+    }
+    if (std::chrono::steady_clock::now() < timers.top().due) {
+      // woken early by a sooner timer or by shutdown, either way re-check from the top
+      timer_condition.wait_until(lock, timers.top().due);
+      continue;
     }
+    task_fn task = timers.top().task;
+    const int64_t lane = timers.top().lane;
+    timers.pop();
+    --queued_timers;
+    lock.unlock();
+    enqueue_task(std::make_shared<Message>(), [task = std::move(task)](const Message&) {
+      task();
+      return Message();
+    }, false, lane);
+    lock.lock();
   }
 }
 
@@ -1,11 +1,21 @@
 #ifndef COMMON_NODE_HEADER
 #define COMMON_NODE_HEADER
+#include "concurrent_hash_map.h"
 #include "message.h"
+#include "snapshot_file.h"
 #include "snowflake.h"
+#include "spsc_ring.h"
+#include "transport.h"
+#include "wal.h"
 #include "../ext/nlohmann/json.hpp"
+#include <chrono>
 #include <condition_variable>
+#include <optional>
+#include <deque>
 #include <queue>
+#include <random>
 #include <atomic>
+#include <memory>
 #include <mutex>
 
 class Node 
@@ -19,12 +29,143 @@ public:
 
   using callback_fn = std::function<Message(const Message&)>;
   void register_handler(MessageType type, callback_fn handler);
+  // hashes incoming requests onto `lanes` serial queues: requests on one lane run one at a time and in arrival order,
+  // separate lanes still run in parallel. requests are keyed by their sender unless their type has a key of its own.
+  // timers scheduled and rpc replies awaited from a task on a lane run on that lane again, so state only ever
+  // touched through one key, by its handlers and their callbacks, needs no locking. only valid before run()
+  void enable_lanes(std::size_t lanes);
+  using lane_key_fn = std::function<uint64_t(const Message&)>;
+  void set_lane_key(MessageType type, lane_key_fn key);
+
+  // fire-and-forget, writes the message out as-is
+  void send(const Message& msg);
+  // sends the message and invokes `on_reply` on a worker once a message with a matching 'in_reply_to' arrives,
+  // with a non-zero timeout `on_reply` gets a synthesized 'error' (code 0) if no reply shows up in time
+  using reply_fn = std::function<void(const Message&)>;
+  void rpc(const Message& msg, reply_fn on_reply, std::chrono::milliseconds timeout = std::chrono::milliseconds::zero());
+
+  // runs `task` on a worker once `delay` has passed
+  using task_fn = std::function<void()>;
+  void schedule(std::chrono::microseconds delay, task_fn task);
+
+  // shard-per-core: every worker becomes a shard pinned to a core of its own and fed through single-producer rings
+  // instead of the shared queue. requests go to the shard their lane key hashes to, timers and rpc replies back to
+  // the shard that scheduled or sent them, so state partitioned by that key is only ever touched by its shard.
+  // under a queue limit only REJECT applies. only valid before run() and with workers
+  void enable_shards(std::size_t ring_capacity = 256);
+  auto shard_count() const -> std::size_t { return shards.size(); }
+  auto shard_of(uint64_t key) const -> std::size_t { return key % shards.size(); }
+  // the shard running the caller, -1 off the shards
+  static auto current_shard() -> int64_t;
+  // cross-shard message passing: runs `task` on `shard`
+  void post(std::size_t shard, task_fn task);
+
+  // hands a message to the node as if it had been read from stdin
+  void deliver(Message&& msg);
+  // messages addressed to `name` go to `service` instead of stdout, only valid before run()
+  using local_service_fn = std::function<void(const Message&)>;
+  void register_local_service(std::string_view name, local_service_fn service);
+
+  // keeps handler state in a write-ahead log under `directory`, replayed on init. only valid before run().
+  // with a non-zero `checkpoint_every` the node checkpoints after that many records: every stream registered
+  // with `register_checkpoint` is dumped into a snapshot file and the log restarts empty, so init only has to
+  // map the snapshots and replay what was logged since
+  void enable_wal(std::string directory, uint64_t checkpoint_every = 0);
+  // logs `record` under `stream` and sends `response` once it is durable, right away without a log.
+  // a handler that persists returns Message() and leaves the reply to this
+  void persist(std::string_view stream, const json& record, Message response);
+  // logs `record` under `stream` and runs `on_durable` once it is, right away without a log.
+  // runs on the log's committer thread, it should not block
+  void persist(std::string_view stream, const json& record, task_fn on_durable);
+  // `replay` receives every record logged under `stream` while the node initializes, only valid before run()
+  using replay_fn = std::function<void(const json&)>;
+  void register_replay(std::string_view stream, replay_fn replay);
+  // `dump` writes the stream's whole state, `restore` gets the latest snapshot on init before any record is
+  // replayed. the snapshot is mapped, not read, pages come in as `restore`'s owner looks keys up.
+  // only valid before run()
+  using dump_fn = std::function<void(SnapshotWriter&)>;
+  using restore_fn = std::function<void(std::shared_ptr<const SnapshotFile>)>;
+  void register_checkpoint(std::string_view stream, dump_fn dump, restore_fn restore);
+
+  // the clock `schedule` and timeouts run on, steady_clock unless replaced. the worker pool's timer thread
+  // sleeps on steady_clock, a replaced clock only makes sense for a node driven through `fire_timers`
+  using clock_fn = std::function<std::chrono::steady_clock::time_point()>;
+  void set_clock(clock_fn clock);
+  auto now() const -> std::chrono::steady_clock::time_point;
+  // where messages are read from and written to, stdin/stdout unless replaced. only valid before run()
+  void set_transport(std::unique_ptr<Transport> transport);
+  // bounds how many incoming requests may wait for a worker, a limit of 0 (the default) leaves the queue unbounded.
+  // timers and rpc replies are always queued and never shed. only valid before run()
+  enum OverloadPolicy : int {
+    // the reader stops reading until a worker takes a request off the queue, needs workers
+    BLOCK,
+    // the oldest waiting request is dropped unanswered
+    SHED_OLDEST,
+    // the new request is answered with error 11, temporarily unavailable
+    REJECT,
+  };
+  void set_queue_limit(std::size_t limit, OverloadPolicy policy);
+  // pins the reader and timer thread to `reader_cpu` and worker i to `worker_cpus[i % size]`. a worker is pinned
+  // before its first allocation, so its malloc arena comes from its own numa node. without worker cpus only
+  // shards are pinned, round-robin over the allowed cpus. only valid before run()
+  void set_placement(std::optional<int> reader_cpu, std::vector<int> worker_cpus);
+  // what a worker or shard does while it has nothing to run. spinning trades a core per worker for not paying a
+  // futex wake-up on every message. only valid before run()
+  enum IdleStrategy : int {
+    // sleeps on the queue until woken
+    PARK,
+    // polls the queue without ever giving up the core, needs a core per worker
+    BUSY_SPIN,
+    // polls for `spin`, then yields the core between polls
+    SPIN_YIELD,
+    // polls for up to `spin`, then parks. spins only as long as work recently took to arrive, a worker that keeps
+    // waiting longer than `spin` parks right away
+    SPIN_PARK,
+  };
+  void set_idle_strategy(IdleStrategy strategy, std::chrono::microseconds spin = std::chrono::microseconds(50));
+  // handlers draw their randomness from here, so a seeded node makes the same choices every run
+  void seed(uint64_t seed);
+  auto random() -> uint64_t;
+
+  // for driving a node constructed without workers from a single thread, e.g. a simulator:
+  // nothing runs until the owner moves due timers onto the queue and runs what is queued
+  auto next_timer() -> std::optional<std::chrono::steady_clock::time_point>;
+  void fire_timers();
+  // runs queued tasks on the calling thread until none are left, the number run
+  auto run_pending() -> std::size_t;
+
+  auto node_id() const  -> std::string_view                 { return self_node_id; }
+  auto node_ids() const -> const std::vector<std::string>&  { return all_node_ids; }
 
 private:
   auto handle_init(const Message& msg) -> Message;
+  // counters, latency percentiles, queue depths, worker utilization and allocator figures. read from atomics
+  // and per-thread histogram buckets, a scrape takes no lock the workers contend on
+  auto handle_stats(const Message& msg) -> Message;
   void dispatch_message(std::string&& raw);
+  void dispatch(Message&& msg);
+  // `request` tasks count against the queue limit, tasks with a `lane` wait for the ones before them on it
+  void enqueue_task(std::shared_ptr<Message>&& msg, callback_fn&& invoke, bool request = false, int64_t lane = -1);
+  void write_message(const Message& msg);
 
-  void worker_loop();
+  // pins the calling worker according to the placement, if any
+  void place_worker(std::size_t index);
+  void worker_loop(std::size_t index);
+  // per worker, how long it went without work the last few times it ran out
+  struct IdleState {
+    std::chrono::nanoseconds              average_gap{ 0 };
+    std::chrono::steady_clock::time_point since;
+    bool                                  waiting = false;
+  };
+  // polls `ready` the way the idle strategy says, true once it holds or on shutdown, false if it is time to park
+  template<typename ready_fn>
+  auto spin_for_work(IdleState& idle, ready_fn ready) const -> bool;
+  // folds the gap since the worker went idle into its average, once it has work again
+  void end_idle(IdleState& idle) const;
+  void shard_loop(std::size_t index);
+  void timer_loop();
+  // dumps the metrics on every SIGUSR1 until shutdown
+  void signal_loop();
 
 private:
   std::unordered_map<MessageType, callback_fn> handler_map;
@@ -38,15 +179,126 @@ private:
   std::string_view          self_node_id;
   std::vector<std::string>  all_node_ids;
 
-  std::mutex                mutex_write_response;
+  std::unordered_map<std::string, local_service_fn> local_services;
+
+  void recover(std::string_view self_id);
+  void checkpoint();
+  auto write_checkpoint(uint64_t next) -> bool;
+  auto wal_path(uint64_t generation) const -> std::string;
+  auto snapshot_path(uint64_t generation, std::string_view stream) const -> std::string;
+  struct Checkpointer {
+    dump_fn     dump;
+    restore_fn  restore;
+  };
+  std::string                                   wal_directory;
+  std::string                                   wal_prefix;
+  std::unique_ptr<WriteAheadLog>                wal;
+  std::unordered_map<std::string, replay_fn>    replay_handlers;
+  std::unordered_map<std::string, Checkpointer> checkpointers;
+  uint64_t                                      checkpoint_every;
+  // the generation being logged to, and the one the manifest names. they differ after a failed checkpoint or
+  // a recovery that found later logs, everything from the manifest's up to the next one is left to delete
+  std::atomic<uint64_t>                         generation;
+  uint64_t                                      checkpointed_generation;
+  std::atomic<uint64_t>                         logged_since_checkpoint;
+  std::atomic<bool>                             checkpointing;
+
+  struct PendingRpc {
+    reply_fn  on_reply;
+    // the lane or shard that sent it, -1 from anywhere else
+    int64_t   lane;
+  };
+  // the lane or shard the calling thread is running a task of, timers and replies it sets up go back there
+  auto origin_lane() const -> int64_t;
+  ConcurrentHashMap<Snowflake, PendingRpc>    pending_rpcs;
+  std::atomic<int64_t>                        outstanding_rpcs;
 
   struct ThreadTask {
     std::shared_ptr<Message> message;
     callback_fn invoke;
+    std::chrono::steady_clock::time_point enqueued;
+    uint64_t trace;
+    bool request;
+    int64_t lane;
   };
+  void run_task(ThreadTask& task);
+  // pops the front task, `mutex_thread_tasks` held
+  auto take_task() -> ThreadTask;
+  // answers a request the queue has no room for with error 11
+  void reject(const Message& msg);
+  // drops the oldest waiting request, nullptr if none is waiting. `mutex_thread_tasks` held
+  auto shed_oldest() -> std::shared_ptr<Message>;
+  // queues the next task of `lane`, or marks it idle. `mutex_thread_tasks` held
+  void advance_lane(int64_t lane);
+  // after running a task, frees up its lane for the next one
+  void finish_task(const ThreadTask& task);
   std::mutex                mutex_thread_tasks;
-  std::queue<ThreadTask>    task_queue;
+  std::deque<ThreadTask>    task_queue;
   std::condition_variable   queue_condition;
+  // `task_queue.size()`, for spinning workers to poll without the lock
+  std::atomic<int64_t>      runnable_tasks;
+  std::atomic<int64_t>      queued_tasks;
+  std::atomic<int64_t>      queued_requests;
+  std::size_t               queue_limit;
+  OverloadPolicy            overload_policy;
+  // a BLOCKed reader waits here for a request to leave the queue
+  std::condition_variable   space_condition;
+  struct Lane {
+    // a task of this lane is queued or running, the rest waits in `backlog`
+    bool                    busy = false;
+    std::deque<ThreadTask>  backlog;
+  };
+  std::vector<Lane>         lanes;
+  std::unordered_map<MessageType, lane_key_fn> lane_keys;
+
+  struct Inbox {
+    explicit Inbox(std::size_t capacity) : ring(capacity) {}
+    SpscRing<ThreadTask>    ring;
+    // used while the ring is full and by threads that are no known producer, drained once the ring is empty.
+    // a producer keeps to the overflow until it is drained, so its tasks stay in order
+    std::mutex              mutex_overflow;
+    std::deque<ThreadTask>  overflow;
+    std::atomic<bool>       overflowing{ false };
+  };
+  struct Shard {
+    // one per producer: the reader, the timer thread, then every shard
+    std::vector<std::unique_ptr<Inbox>> inboxes;
+    std::size_t             next_inbox = 0;
+    std::atomic<bool>       parked{ false };
+    std::atomic<uint32_t>   wakeups{ 0 };
+  };
+  // pushes into the target shard's inbox for the calling thread and wakes the shard if it is parked
+  void route_to_shard(ThreadTask&& task);
+  auto take_from_shard(Shard& shard, ThreadTask& task) -> bool;
+  auto shard_idle(Shard& shard) const -> bool;
+  void wake_shard(Shard& shard);
+  std::size_t               shard_ring_capacity;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<uint64_t>     next_shard;
+
+  struct Timer {
+    std::chrono::steady_clock::time_point due;
+    task_fn task;
+    int64_t lane;
+
+    auto operator>(const Timer& other) const -> bool { return due > other.due; }
+  };
+  std::mutex                mutex_timers;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+  std::condition_variable   timer_condition;
+  std::atomic<int64_t>      queued_timers;
+
+  std::chrono::steady_clock::time_point started_at;
+  clock_fn                  clock;
+  std::unique_ptr<Transport> transport;
+  // set in run(), before any thread that could schedule is started
+  bool                      timers_in_transport;
+  std::mutex                mutex_random;
+  std::mt19937_64           random_engine;
+  std::optional<int>        reader_cpu;
+  std::vector<int>          worker_cpus;
+  IdleStrategy              idle_strategy;
+  std::chrono::nanoseconds  idle_spin;
 
   const int worker_count;
   // 4
@@ -0,0 +1,64 @@
+#include "options.h"
+#include <charconv>
+#include <iostream>
+
+
+Options::Options(int argc, const char** argv)
+{
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    if (!arg.starts_with("--")) {
+      std::clog << "[❓][SYS] ignoring argument '" << arg << "'\n";
+      continue;
+    }
+    arg.remove_prefix(2);
+    const std::size_t eq = arg.find('=');
+    if (eq == std::string_view::npos)
+      flags.insert_or_assign(std::string(arg), std::string());
+    else
+      flags.insert_or_assign(std::string(arg.substr(0, eq)), std::string(arg.substr(eq + 1)));
+  }
+}
+
+
+auto Options::has(std::string_view name) const -> bool
+{
+  return flags.contains(std::string(name));
+}
+
+
+auto Options::get(std::string_view name) const -> std::optional<std::string_view>
+{
+  auto found = flags.find(std::string(name));
+  if (found == flags.end())
+    return std::nullopt;
+  return found->second;
+}
+
+
+auto Options::get_int(std::string_view name, long fallback) const -> long
+{
+  std::optional<std::string_view> raw = get(name);
+  if (!raw.has_value())
+    return fallback;
+  long out = fallback;
+  if (auto [_, ec] = std::from_chars(raw->data(), raw->data() + raw->size(), out); ec != std::errc()) {
+    std::clog << "[❓][SYS] --" << name << " is not an integer, using " << fallback << '\n';
+    return fallback;
+  }
+  return out;
+}
+
+
+auto Options::get_double(std::string_view name, double fallback) const -> double
+{
+  std::optional<std::string_view> raw = get(name);
+  if (!raw.has_value())
+    return fallback;
+  double out = fallback;
+  if (auto [_, ec] = std::from_chars(raw->data(), raw->data() + raw->size(), out); ec != std::errc()) {
+    std::clog << "[❓][SYS] --" << name << " is not a number, using " << fallback << '\n';
+    return fallback;
+  }
+  return out;
+}
@@ -0,0 +1,24 @@
+#ifndef COMMON_OPTIONS_HEADER
+#define COMMON_OPTIONS_HEADER
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// `--name` / `--name=value` command line flags.
+// maelstrom runs the binary without arguments, so every flag has to have a sane default
+class Options
+{
+public:
+  Options(int argc, const char** argv);
+
+  auto has(std::string_view name) const -> bool;
+  auto get(std::string_view name) const -> std::optional<std::string_view>;
+  auto get_int(std::string_view name, long fallback) const -> long;
+  auto get_double(std::string_view name, double fallback) const -> double;
+
+private:
+  std::unordered_map<std::string, std::string> flags;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "snapshot_file.h"
+#include "common/encoding/crc32.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr std::size_t header_size = 16;
+  constexpr std::size_t footer_size = 40;
+  constexpr std::size_t entry_header_size = 8;
+  constexpr std::size_t index_entry_header_size = 20;
+
+  template<typename T>
+  void put(std::string& out, T value)
+  {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+  }
+
+  template<typename T>
+  auto get(const char* in) -> T
+  {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    return value;
+  }
+}
+
+
+SnapshotFile::~SnapshotFile()
+{
+  if (nullptr != data)
+    ::munmap(const_cast<char*>(data), length);
+}
+
+
+auto SnapshotFile::open(const std::string& path) -> std::unique_ptr<SnapshotFile>
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < header_size + footer_size) {
+    ::close(fd);
+    std::clog << "[❌][SNP] '" << path << "' is too short to be a snapshot\n";
+    return nullptr;
+  }
+  void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive on its own
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    std::clog << "[❌][SNP] cannot map '" << path << "': " << std::strerror(errno) << '\n';
+    return nullptr;
+  }
+  // lookups hop between blocks, read-ahead would only pull in pages nobody asked for
+  ::madvise(mapped, info.st_size, MADV_RANDOM);
+
+  std::unique_ptr<SnapshotFile> snapshot(new SnapshotFile());
+  snapshot->data = static_cast<const char*>(mapped);
+  snapshot->length = info.st_size;
+  const char* base = snapshot->data;
+
+  const char* footer = base + snapshot->length - footer_size;
+  const uint64_t index_offset = get<uint64_t>(footer);
+  const uint64_t index_size = get<uint64_t>(footer + 8);
+  const uint64_t block_count = get<uint64_t>(footer + 16);
+  snapshot->entries = get<uint64_t>(footer + 24);
+  const uint32_t index_crc = get<uint32_t>(footer + 32);
+  if (get<uint32_t>(base) != magic || get<uint32_t>(footer + 36) != magic) {
+    std::clog << "[❌][SNP] '" << path << "' is not a snapshot\n";
+    return nullptr;
+  }
+  if (get<uint32_t>(base + 4) != version) {
+    std::clog << "[❌][SNP] '" << path << "' has version " << get<uint32_t>(base + 4) << ", expected " << version << '\n';
+    return nullptr;
+  }
+  // none of the footer is covered by the crc. the index has to lie between header and footer, compared without
+  // adding untrusted numbers that could wrap, and the block count has to fit it before anything is sized by it
+  const uint64_t index_end_offset = snapshot->length - footer_size;
+  if (index_offset < header_size || index_offset > index_end_offset || index_size != index_end_offset - index_offset
+      || block_count > index_size / index_entry_header_size
+      || encoding::crc32(std::string_view(base + index_offset, index_size)) != index_crc) {
+    std::clog << "[❌][SNP] '" << path << "' has a damaged index\n";
+    return nullptr;
+  }
+
+  snapshot->blocks.reserve(block_count);
+  const char* cursor = base + index_offset;
+  const char* index_end = cursor + index_size;
+  for (uint64_t idx = 0; idx < block_count; ++idx) {
+    if (cursor + index_entry_header_size > index_end)
+      return nullptr;
+    const uint64_t offset = get<uint64_t>(cursor);
+    const uint32_t size = get<uint32_t>(cursor + 8);
+    const uint32_t key_length = get<uint32_t>(cursor + 16);
+    cursor += index_entry_header_size;
+    if (key_length > static_cast<std::size_t>(index_end - cursor) || offset > index_offset || size > index_offset - offset)
+      return nullptr;
+    snapshot->blocks.push_back({ offset, size, std::string_view(cursor, key_length) });
+    cursor += key_length;
+  }
+  return snapshot;
+}
+
+
+auto SnapshotFile::find(std::string_view key) const -> std::optional<std::string_view>
+{
+  // the last block starting at or before the key is the only one that can hold it
+  auto after = std::upper_bound(blocks.begin(), blocks.end(), key, [](std::string_view lhs, const Block& rhs) {
+    return lhs < rhs.first_key;
+  });
+  if (after == blocks.begin())
+    return std::nullopt;
+  std::optional<std::string_view> found;
+  scan(*std::prev(after), [&](std::string_view entry_key, std::string_view value) {
+    if (entry_key < key)
+      return true;
+    if (entry_key == key)
+      found = value;
+    return false;
+  });
+  return found;
+}
+
+
+void SnapshotFile::for_each(const std::function<void(std::string_view, std::string_view)>& fn) const
+{
+  for (const Block& block : blocks) {
+    scan(block, [&](std::string_view key, std::string_view value) {
+      fn(key, value);
+      return true;
+    });
+  }
+}
+
+
+template<typename Fn>
+auto SnapshotFile::scan(const Block& block, Fn&& fn) const -> bool
+{
+  const char* cursor = data + block.offset;
+  const char* end = cursor + block.size;
+  while (cursor + entry_header_size <= end) {
+    const uint32_t key_length = get<uint32_t>(cursor);
+    const uint32_t value_length = get<uint32_t>(cursor + 4);
+    cursor += entry_header_size;
+    if (cursor + key_length + value_length > end)
+      return false;
+    if (!fn(std::string_view(cursor, key_length), std::string_view(cursor + key_length, value_length)))
+      return false;
+    cursor += key_length + value_length;
+  }
+  return true;
+}
+
+
+SnapshotWriter::~SnapshotWriter()
+{
+  if (fd < 0)
+    return;
+  ::close(fd);
+  ::unlink((path + ".tmp").c_str());
+}
+
+
+auto SnapshotWriter::open(const std::string& file) -> bool
+{
+  path = file;
+  fd = ::open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::clog << "[❌][SNP] cannot create '" << path << ".tmp': " << std::strerror(errno) << '\n';
+    return false;
+  }
+  std::string header;
+  put<uint32_t>(header, SnapshotFile::magic);
+  put<uint32_t>(header, SnapshotFile::version);
+  put<uint64_t>(header, 0);
+  return write_all(header);
+}
+
+
+auto SnapshotWriter::add(std::string_view key, std::string_view value) -> bool
+{
+  if (failed || fd < 0)
+    return false;
+  if (entries > 0 && key <= last_key) {
+    std::clog << "[❌][SNP] keys added out of order to '" << path << "'\n";
+    failed = true;
+    return false;
+  }
+  if (block.empty())
+    index.push_back({ offset, 0, 0, std::string(key) });
+  put<uint32_t>(block, static_cast<uint32_t>(key.size()));
+  put<uint32_t>(block, static_cast<uint32_t>(value.size()));
+  block.append(key);
+  block.append(value);
+  ++block_entries;
+  ++entries;
+  last_key.assign(key);
+  return block.size() < block_size || flush_block();
+}
+
+
+auto SnapshotWriter::finish() -> bool
+{
+  if (failed || fd < 0 || !flush_block())
+    return false;
+
+  std::string encoded;
+  for (const IndexEntry& entry : index) {
+    put<uint64_t>(encoded, entry.offset);
+    put<uint32_t>(encoded, entry.size);
+    put<uint32_t>(encoded, entry.entries);
+    put<uint32_t>(encoded, static_cast<uint32_t>(entry.first_key.size()));
+    encoded.append(entry.first_key);
+  }
+  std::string footer;
+  put<uint64_t>(footer, offset);
+  put<uint64_t>(footer, encoded.size());
+  put<uint64_t>(footer, index.size());
+  put<uint64_t>(footer, entries);
+  put<uint32_t>(footer, encoding::crc32(encoded));
+  put<uint32_t>(footer, SnapshotFile::magic);
+  if (!write_all(encoded) || !write_all(footer))
+    return false;
+
+  if (::fsync(fd) != 0 || ::close(fd) != 0) {
+    std::clog << "[❌][SNP] cannot sync '" << path << ".tmp': " << std::strerror(errno) << '\n';
+    fd = -1;
+    return false;
+  }
+  fd = -1;
+  if (std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+    std::clog << "[❌][SNP] cannot move '" << path << "' into place: " << std::strerror(errno) << '\n';
+    return false;
+  }
+  return true;
+}
+
+
+auto SnapshotWriter::flush_block() -> bool
+{
+  if (block.empty())
+    return true;
+  index.back().size = static_cast<uint32_t>(block.size());
+  index.back().entries = block_entries;
+  const bool written = write_all(block);
+  block.clear();
+  block_entries = 0;
+  return written;
+}
+
+
+auto SnapshotWriter::write_all(std::string_view bytes) -> bool
+{
+  while (!bytes.empty()) {
+    const ssize_t put = ::write(fd, bytes.data(), bytes.size());
+    if (put < 0 && errno == EINTR)
+      continue;
+    if (put <= 0) {
+      std::clog << "[❌][SNP] write to '" << path << ".tmp' failed: " << std::strerror(errno) << '\n';
+      failed = true;
+      return false;
+    }
+    bytes.remove_prefix(put);
+    offset += put;
+  }
+  return true;
+}
@@ -0,0 +1,94 @@
+#ifndef COMMON_SNAPSHOT_FILE_HEADER
+#define COMMON_SNAPSHOT_FILE_HEADER
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// immutable on-disk key/value snapshot, read straight out of a read-only mapping.
+// layout, integers little-endian:
+//   header  [u32 magic][u32 version][u64 reserved]
+//   blocks  entries sorted by key, [u32 key length][u32 value length][key][value] each, ~`block_size` per block
+//   index   per block [u64 offset][u32 size][u32 entries][u32 first key length][first key]
+//   footer  [u64 index offset][u64 index size][u64 blocks][u64 entries][u32 index crc32][u32 magic]
+// opening a snapshot touches the footer and the index only, a lookup pages in one block.
+class SnapshotFile
+{
+public:
+  static constexpr uint32_t magic   = 0x504e534d; // "MSNP"
+  static constexpr uint32_t version = 1;
+
+  ~SnapshotFile();
+  SnapshotFile(const SnapshotFile&) = delete;
+  auto operator=(const SnapshotFile&) -> SnapshotFile& = delete;
+
+  // nullptr if the file is missing, truncated, of another version or its index does not check out
+  static auto open(const std::string& path) -> std::unique_ptr<SnapshotFile>;
+
+  // views into the mapping, valid as long as the snapshot is
+  auto find(std::string_view key) const -> std::optional<std::string_view>;
+  void for_each(const std::function<void(std::string_view, std::string_view)>& fn) const;
+
+  auto size() const -> uint64_t { return entries; }
+
+private:
+  SnapshotFile() = default;
+
+  struct Block {
+    uint64_t          offset;
+    uint32_t          size;
+    std::string_view  first_key;
+  };
+  template<typename Fn>
+  auto scan(const Block& block, Fn&& fn) const -> bool;
+
+  const char*         data    = nullptr;
+  std::size_t         length  = 0;
+  uint64_t            entries = 0;
+  std::vector<Block>  blocks;
+};
+
+// writes a snapshot file from entries added in strictly ascending key order, into `path`.tmp first.
+// `finish` syncs it and renames it into place, so a snapshot at `path` is always complete
+class SnapshotWriter
+{
+public:
+  static constexpr std::size_t block_size = 4096;
+
+  SnapshotWriter() = default;
+  ~SnapshotWriter();
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  auto operator=(const SnapshotWriter&) -> SnapshotWriter& = delete;
+
+  auto open(const std::string& path) -> bool;
+  // false once an entry is out of order or a write failed, the snapshot is then never finished
+  auto add(std::string_view key, std::string_view value) -> bool;
+  auto finish() -> bool;
+
+private:
+  auto flush_block() -> bool;
+  auto write_all(std::string_view bytes) -> bool;
+
+  struct IndexEntry {
+    uint64_t    offset;
+    uint32_t    size;
+    uint32_t    entries;
+    std::string first_key;
+  };
+
+  int                     fd      = -1;
+  std::string             path;
+  bool                    failed  = false;
+  uint64_t                offset  = 0;
+  uint64_t                entries = 0;
+  std::string             last_key;
+  std::string             block;
+  uint32_t                block_entries = 0;
+  std::vector<IndexEntry> index;
+};
+
+#endif
@@ -1,11 +1,24 @@
 #include "snowflake.h"
 #include "common/encoding/base64.h"
 #include "ext/nlohmann/json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <optional>
 #include <random>
 
+namespace {
+  // 2020-01-01, keeps ordered ids below 2^63 for the next few decades
+  constexpr uint64_t ordered_epoch_ms = 1577836800000;
+  constexpr int      sequence_bits    = 12;
+  constexpr int      node_bits        = 10;
+
+  // hybrid logical clock behind ordered ids: milliseconds << sequence_bits | sequence
+  std::atomic<uint64_t> ordered_clock = 0;
+}
+
 Snowflake Snowflake::invalid_snowflake(0, 0);
 
 Snowflake::Snowflake()
@@ -37,6 +50,27 @@ auto Snowflake::generate_64() -> Self
   return out;
 }
 
+auto Snowflake::generate_ordered(uint16_t node) -> Self
+{
+  const auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+  const uint64_t now = (std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch).count() - ordered_epoch_ms) << sequence_bits;
+  uint64_t last = ordered_clock.load();
+  uint64_t next;
+  // a sequence overflow simply borrows the next millisecond
+  do {
+    next = std::max(last + 1, now);
+  } while (!ordered_clock.compare_exchange_weak(last, next));
+  return Snowflake((next << node_bits) | (node & ((1u << node_bits) - 1)), 0);
+}
+
+void Snowflake::witness(const Self& observed)
+{
+  const uint64_t clock = observed.m_most_sig >> node_bits;
+  uint64_t last = ordered_clock.load();
+  while (last < clock && !ordered_clock.compare_exchange_weak(last, clock))
+    ;
+}
+
 auto Snowflake::invalid() -> Self
 {
   return invalid_snowflake;
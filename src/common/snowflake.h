@@ -1,6 +1,7 @@
 #ifndef COMMON_SNOWFLAKE_HEADER
 #define COMMON_SNOWFLAKE_HEADER
 #include "ext/nlohmann/json.hpp"
+#include <compare>
 #include <cstdint>
 
 // thread-safe not-xitter-compliant snowflake impl
@@ -13,11 +14,19 @@ public:
 
   static auto generate()                  -> Self;
   static auto generate_64()               -> Self;
+  // time-ordered id: milliseconds | sequence | node. strictly increasing within the process and never behind
+  // an id passed to `witness`, so comparing them gives last-writer-wins ordering that respects causality
+  static auto generate_ordered(uint16_t node) -> Self;
+  static void witness(const Self& observed);
   static auto invalid()                   -> Self;
   static auto from_json(json::value_type) -> std::optional<Self>;
 
   auto as_json() const -> json::value_type;
   auto is_valid() const   -> bool                   { return m_most_sig != 0 || m_least_sig != 0; }
+  auto hash() const       -> std::size_t            { return std::hash<uint64_t>()(m_most_sig) ^ (std::hash<uint64_t>()(m_least_sig) << 1); }
+
+  auto operator==(const Snowflake& other) const -> bool = default;
+  auto operator<=>(const Snowflake& other) const = default;
 private:
   Snowflake(uint64_t, uint64_t);
 
@@ -30,4 +39,10 @@ private:
   uint64_t m_least_sig;
 };
 
+template<>
+struct std::hash<Snowflake>
+{
+  auto operator()(const Snowflake& id) const -> std::size_t { return id.hash(); }
+};
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef COMMON_SPSC_RING_HEADER
+#define COMMON_SPSC_RING_HEADER
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// bounded queue between exactly one producer and one consumer thread. head and tail sit on their own cache lines,
+// and each side keeps a private copy of the other's index, so the shared line is only read when that copy says
+// full or empty. popped slots keep their moved-from value until overwritten.
+template<typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(std::size_t capacity)
+    : slots(std::bit_ceil(std::max<std::size_t>(capacity, 2)))
+    , mask(slots.size() - 1)
+  {
+  }
+  SpscRing(const SpscRing&) = delete;
+  auto operator=(const SpscRing&) -> SpscRing& = delete;
+
+  // producer only, false if full
+  auto try_push(T&& value) -> bool
+  {
+    const std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+    if (tail - producer.cached_head == slots.size()) {
+      producer.cached_head = consumer.head.load(std::memory_order_acquire);
+      if (tail - producer.cached_head == slots.size())
+        return false;
+    }
+    slots[tail & mask] = std::move(value);
+    producer.tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only, false if empty
+  auto try_pop(T& out) -> bool
+  {
+    const std::size_t head = consumer.head.load(std::memory_order_relaxed);
+    if (head == consumer.cached_tail) {
+      consumer.cached_tail = producer.tail.load(std::memory_order_acquire);
+      if (head == consumer.cached_tail)
+        return false;
+    }
+    out = std::move(slots[head & mask]);
+    consumer.head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only, re-reads the producer's tail
+  auto empty() const -> bool
+  {
+    return consumer.head.load(std::memory_order_relaxed) == producer.tail.load(std::memory_order_seq_cst);
+  }
+
+  auto capacity() const -> std::size_t { return slots.size(); }
+
+private:
+  struct alignas(64) Producer {
+    std::atomic<std::size_t> tail{ 0 };
+    std::size_t              cached_head = 0;
+  };
+  struct alignas(64) Consumer {
+    std::atomic<std::size_t> head{ 0 };
+    std::size_t              cached_tail = 0;
+  };
+
+  Producer              producer;
+  Consumer              consumer;
+  std::vector<T>        slots;
+  const std::size_t     mask;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "trace.h"
+#include "ext/nlohmann/json.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+  struct Event {
+    const char*   name;
+    MessageType   type;
+    uint64_t      trace;
+    uint64_t      start;
+    uint64_t      end;
+  };
+
+  // written by its thread only, read by `flush` once the node has stopped
+  struct Ring {
+    std::array<Event, Trace::ring_capacity> events;
+    uint64_t                                written = 0;
+    std::size_t                             thread  = 0;
+  };
+
+  std::atomic<bool>                   enabled       = false;
+  std::string                         output;
+  uint64_t                            sample_every  = 1;
+  std::atomic<uint64_t>               seen          = 0;
+  std::atomic<uint64_t>               next_trace    = 1;
+  const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+  std::mutex                          mutex_rings;
+  // shared so spans of threads that already exited still make it into the output
+  std::vector<std::shared_ptr<Ring>>  rings;
+
+  thread_local uint64_t               current_trace = 0;
+  thread_local std::shared_ptr<Ring>  local;
+
+  auto ring() -> Ring&
+  {
+    if (nullptr == local) {
+      local = std::make_shared<Ring>();
+      std::unique_lock lock(mutex_rings);
+      local->thread = rings.size();
+      rings.push_back(local);
+    }
+    return *local;
+  }
+}
+
+
+void Trace::enable(std::string path, uint64_t every)
+{
+  output = std::move(path);
+  sample_every = every == 0 ? 1 : every;
+  enabled = true;
+}
+
+
+auto Trace::sample() -> uint64_t
+{
+  if (!enabled.load(std::memory_order_relaxed))
+    return 0;
+  if (seen.fetch_add(1, std::memory_order_relaxed) % sample_every != 0)
+    return 0;
+  return next_trace.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+auto Trace::now() -> uint64_t
+{
+  return at(std::chrono::steady_clock::now());
+}
+
+
+auto Trace::at(std::chrono::steady_clock::time_point time) -> uint64_t
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time - origin).count();
+}
+
+
+void Trace::record(const char* name, uint64_t trace, MessageType type, uint64_t start, uint64_t end)
+{
+  if (trace == 0)
+    return;
+  Ring& target = ring();
+  target.events[target.written % ring_capacity] = { name, type, trace, start, end };
+  ++target.written;
+}
+
+
+auto Trace::current() -> uint64_t
+{
+  return current_trace;
+}
+
+
+auto Trace::flush() -> bool
+{
+  if (!enabled)
+    return true;
+  std::ofstream out(output, std::ios::trunc);
+  if (!out) {
+    std::clog << "[❌][TRC] cannot write trace to '" << output << "'\n";
+    return false;
+  }
+  std::size_t exported = 0;
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  std::unique_lock lock(mutex_rings);
+  for (const std::shared_ptr<Ring>& thread : rings) {
+    const uint64_t first = thread->written > ring_capacity ? thread->written - ring_capacity : 0;
+    for (uint64_t idx = first; idx < thread->written; ++idx) {
+      const Event& event = thread->events[idx % ring_capacity];
+      nlohmann::json args = { { "trace", event.trace } };
+      if (event.type != INVALID)
+        args["type"] = message_type_to_string(event.type);
+      const nlohmann::json span = {
+        { "name", event.name },
+        { "cat",  "msg" },
+        { "ph",   "X" },
+        { "ts",   event.start / 1e3 },
+        { "dur",  (event.end - event.start) / 1e3 },
+        { "pid",  1 },
+        { "tid",  thread->thread },
+        { "args", std::move(args) },
+      };
+      out << (exported++ == 0 ? "\n" : ",\n") << span.dump();
+    }
+  }
+  out << "\n]}\n";
+  std::clog << "[✅][TRC] wrote " << exported << " spans to '" << output << "'\n";
+  return static_cast<bool>(out);
+}
+
+
+Trace::Context::Context(uint64_t trace)
+  : previous(current_trace)
+{
+  current_trace = trace;
+}
+
+
+Trace::Context::~Context()
+{
+  current_trace = previous;
+}
+
+
+Trace::Span::Span(const char* name, MessageType type)
+  : name(name)
+  , type(type)
+  , trace(current_trace)
+  , start(trace == 0 ? 0 : Trace::now())
+{
+}
+
+
+Trace::Span::~Span()
+{
+  if (trace != 0)
+    record(name, trace, type, start, Trace::now());
+}
@@ -0,0 +1,60 @@
+#ifndef COMMON_TRACE_HEADER
+#define COMMON_TRACE_HEADER
+#include "message.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// optional per-message tracing: sampled messages get a trace id at read time, every stage they pass through
+// (read, parse, enqueue, queued, handle, serialize, write) leaves a span in a ring owned by the recording
+// thread. rings overwrite their oldest spans, so tracing can stay on under load at bounded memory.
+// `flush` writes everything still held as Chrome trace-event JSON, loadable in chrome://tracing or Perfetto.
+// with tracing off, or for unsampled messages, a span costs one branch.
+class Trace
+{
+public:
+  static constexpr std::size_t ring_capacity = 1 << 14;
+
+  // traces one message in every `sample_every`, written to `path` by `flush`. only valid before run()
+  static void enable(std::string path, uint64_t sample_every);
+  // a fresh trace id if the next message is sampled, 0 otherwise
+  static auto sample() -> uint64_t;
+  // nanoseconds on the trace's clock
+  static auto now() -> uint64_t;
+  static auto at(std::chrono::steady_clock::time_point time) -> uint64_t;
+
+  // spans with trace id 0 are dropped
+  static void record(const char* name, uint64_t trace, MessageType type, uint64_t start, uint64_t end);
+  // the trace the calling thread is working on, 0 if none
+  static auto current() -> uint64_t;
+  static auto flush() -> bool;
+
+  // makes `trace` the calling thread's current one for its scope
+  class Context
+  {
+  public:
+    explicit Context(uint64_t trace);
+    ~Context();
+    Context(const Context&) = delete;
+    auto operator=(const Context&) -> Context& = delete;
+  private:
+    uint64_t previous;
+  };
+
+  // records a span of the current trace over its scope
+  class Span
+  {
+  public:
+    explicit Span(const char* name, MessageType type = INVALID);
+    ~Span();
+    Span(const Span&) = delete;
+    auto operator=(const Span&) -> Span& = delete;
+  private:
+    const char*       name;
+    const MessageType type;
+    const uint64_t    trace;
+    const uint64_t    start;
+  };
+};
+
+#endif
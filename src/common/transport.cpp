@@ -0,0 +1,208 @@
+#include "transport.h"
+#include "common/trace.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+  auto unix_address(const std::string& path, sockaddr_un& address) -> bool
+  {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+      std::clog << "[❌][NET] socket path '" << path << "' is too long\n";
+      return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+  }
+}
+
+
+void LineTransport::send(const Message& msg)
+{
+  std::string line;
+  {
+    Trace::Span span("serialize", msg.type);
+    line = msg.as_json().dump();
+  }
+  Trace::Span span("write", msg.type);
+  std::unique_lock lock(mutex_write);
+  write_line(line);
+}
+
+
+auto StdioTransport::read(std::string& line) -> bool
+{
+  return static_cast<bool>(std::getline(std::cin, line));
+}
+
+
+void StdioTransport::write_line(std::string_view line)
+{
+  std::cout << line << std::endl;
+}
+
+
+auto MemoryTransport::pair() -> std::pair<std::unique_ptr<MemoryTransport>, std::unique_ptr<MemoryTransport>>
+{
+  auto channel = std::make_shared<Channel>();
+  return { std::unique_ptr<MemoryTransport>(new MemoryTransport(channel, 0)),
+           std::unique_ptr<MemoryTransport>(new MemoryTransport(channel, 1)) };
+}
+
+
+MemoryTransport::~MemoryTransport()
+{
+  {
+    std::unique_lock lock(channel->mutex);
+    channel->closed = true;
+  }
+  channel->condition.notify_all();
+}
+
+
+auto MemoryTransport::read(std::string& line) -> bool
+{
+  std::unique_lock lock(channel->mutex);
+  std::deque<std::string>& inbox = channel->inboxes[side];
+  channel->condition.wait(lock, [&] { return !inbox.empty() || channel->closed; });
+  // whatever was sent before the other end went away is still read
+  if (inbox.empty())
+    return false;
+  line = std::move(inbox.front());
+  inbox.pop_front();
+  return true;
+}
+
+
+void MemoryTransport::write_line(std::string_view line)
+{
+  {
+    std::unique_lock lock(channel->mutex);
+    if (channel->closed)
+      return;
+    channel->inboxes[1 - side].emplace_back(line);
+  }
+  channel->condition.notify_all();
+}
+
+
+auto SocketTransport::pair() -> std::pair<std::unique_ptr<SocketTransport>, std::unique_ptr<SocketTransport>>
+{
+  int fds[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    std::clog << "[❌][NET] socketpair failed: " << std::strerror(errno) << '\n';
+    return { nullptr, nullptr };
+  }
+  return { std::unique_ptr<SocketTransport>(new SocketTransport(fds[0])),
+           std::unique_ptr<SocketTransport>(new SocketTransport(fds[1])) };
+}
+
+
+auto SocketTransport::listen(const std::string& path) -> std::unique_ptr<SocketTransport>
+{
+  sockaddr_un address;
+  if (!unix_address(path, address))
+    return nullptr;
+  const int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ::unlink(path.c_str());
+  if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+      || ::listen(listener, 1) != 0) {
+    std::clog << "[❌][NET] cannot listen on '" << path << "': " << std::strerror(errno) << '\n';
+    if (listener >= 0)
+      ::close(listener);
+    return nullptr;
+  }
+  std::clog << "[ℹ️][NET] waiting for a connection on '" << path << "'\n";
+  const int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+  ::close(listener);
+  if (fd < 0) {
+    std::clog << "[❌][NET] accept on '" << path << "' failed: " << std::strerror(errno) << '\n';
+    return nullptr;
+  }
+  return std::unique_ptr<SocketTransport>(new SocketTransport(fd));
+}
+
+
+auto SocketTransport::connect(const std::string& path) -> std::unique_ptr<SocketTransport>
+{
+  sockaddr_un address;
+  if (!unix_address(path, address))
+    return nullptr;
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    std::clog << "[❌][NET] cannot connect to '" << path << "': " << std::strerror(errno) << '\n';
+    if (fd >= 0)
+      ::close(fd);
+    return nullptr;
+  }
+  return std::unique_ptr<SocketTransport>(new SocketTransport(fd));
+}
+
+
+SocketTransport::~SocketTransport()
+{
+  ::close(fd);
+}
+
+
+auto SocketTransport::read(std::string& line) -> bool
+{
+  std::size_t scanned = 0;
+  while (true) {
+    if (const std::size_t end = pending.find('\n', scanned); end != std::string::npos) {
+      line.assign(pending, 0, end);
+      pending.erase(0, end + 1);
+      return true;
+    }
+    scanned = pending.size();
+    char buffer[64 * 1024];
+    const ssize_t got = ::read(fd, buffer, sizeof(buffer));
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return false;
+    pending.append(buffer, got);
+  }
+}
+
+
+void SocketTransport::write_line(std::string_view line)
+{
+  iovec parts[2] = {
+    { const_cast<char*>(line.data()), line.size() },
+    { const_cast<char*>("\n"), 1 },
+  };
+  std::size_t remaining = line.size() + 1;
+  iovec* next = parts;
+  int count = 2;
+  while (remaining > 0) {
+    // a peer that hung up gets EPIPE and a logged error, not a SIGPIPE that takes the whole node down
+    msghdr header{};
+    header.msg_iov = next;
+    header.msg_iovlen = count;
+    const ssize_t put = ::sendmsg(fd, &header, MSG_NOSIGNAL);
+    if (put < 0 && errno == EINTR)
+      continue;
+    if (put <= 0) {
+      std::clog << "[❌][NET] write failed: " << std::strerror(errno) << '\n';
+      return;
+    }
+    remaining -= put;
+    // skip what went out, a partial write can end inside either part
+    std::size_t written = put;
+    while (count > 0 && written >= next->iov_len) {
+      written -= next->iov_len;
+      ++next;
+      --count;
+    }
+    if (count > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + written;
+      next->iov_len -= written;
+    }
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef COMMON_TRANSPORT_HEADER
+#define COMMON_TRANSPORT_HEADER
+#include "message.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// where a node reads its messages from and writes them to, one maelstrom message per line.
+// `read` is only ever called from the node's reader thread, `send` from any thread at any time.
+class Transport
+{
+public:
+  virtual ~Transport() = default;
+  // blocks for the next line, false once the other side is gone
+  virtual auto read(std::string& line) -> bool = 0;
+  virtual void send(const Message& msg) = 0;
+
+  // a transport with its own event loop may wait on the node's timers too, it then returns true and the node
+  // runs no timer thread: `fire` queues whatever is due and every newly scheduled timer is passed to `timer_scheduled`
+  using next_timer_fn = std::function<std::optional<std::chrono::steady_clock::time_point>()>;
+  using fire_timers_fn = std::function<void()>;
+  virtual auto drive_timers(next_timer_fn, fire_timers_fn) -> bool { return false; }
+  virtual void timer_scheduled(std::chrono::steady_clock::time_point) {}
+  // once the node stopped and its workers are joined, e.g. to write out what is still buffered
+  virtual void close() {}
+};
+
+// serializes on the sending thread, so only the write of the finished line happens under the lock
+class LineTransport : public Transport
+{
+public:
+  void send(const Message& msg) final;
+protected:
+  // called with the write lock held, `line` comes without its newline
+  virtual void write_line(std::string_view line) = 0;
+private:
+  std::mutex mutex_write;
+};
+
+// maelstrom's stdin/stdout, the default
+class StdioTransport final : public LineTransport
+{
+public:
+  auto read(std::string& line) -> bool override;
+protected:
+  void write_line(std::string_view line) override;
+};
+
+// two connected ends in one process, what one sends the other reads. destroying an end closes both
+class MemoryTransport final : public LineTransport
+{
+public:
+  static auto pair() -> std::pair<std::unique_ptr<MemoryTransport>, std::unique_ptr<MemoryTransport>>;
+  ~MemoryTransport() override;
+
+  auto read(std::string& line) -> bool override;
+protected:
+  void write_line(std::string_view line) override;
+private:
+  struct Channel {
+    std::mutex                            mutex;
+    std::condition_variable               condition;
+    std::array<std::deque<std::string>, 2> inboxes;
+    bool                                  closed = false;
+  };
+  MemoryTransport(std::shared_ptr<Channel> channel, int side) : channel(std::move(channel)), side(side) {}
+
+  std::shared_ptr<Channel>  channel;
+  const int                 side;
+};
+
+// a connected unix stream socket
+class SocketTransport final : public LineTransport
+{
+public:
+  static auto pair() -> std::pair<std::unique_ptr<SocketTransport>, std::unique_ptr<SocketTransport>>;
+  // binds `path` and waits for the first connection, nullptr on failure
+  static auto listen(const std::string& path) -> std::unique_ptr<SocketTransport>;
+  static auto connect(const std::string& path) -> std::unique_ptr<SocketTransport>;
+  ~SocketTransport() override;
+
+  auto read(std::string& line) -> bool override;
+protected:
+  void write_line(std::string_view line) override;
+private:
+  explicit SocketTransport(int fd) : fd(fd) {}
+
+  const int   fd;
+  // bytes received past the last complete line
+  std::string pending;
+};
+
+#endif
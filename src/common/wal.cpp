@@ -0,0 +1,228 @@
+#include "wal.h"
+#include "common/encoding/crc32.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr std::size_t header_size = 2 * sizeof(uint32_t);
+
+  void put_u32(std::string& out, uint32_t value)
+  {
+    char bytes[sizeof(uint32_t)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+  }
+
+  auto get_u32(const char* in) -> uint32_t
+  {
+    uint32_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+  }
+}
+
+
+WriteAheadLog::WriteAheadLog(std::chrono::microseconds linger)
+  : linger(linger)
+  , fd(-1)
+  , stopping(false)
+  , rotations(0)
+  , rotated(false)
+{
+}
+
+
+WriteAheadLog::~WriteAheadLog()
+{
+  stop();
+  if (fd >= 0)
+    ::close(fd);
+}
+
+
+auto WriteAheadLog::open(const std::string& file) -> bool
+{
+  path = file;
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::clog << "[❌][WAL] cannot open '" << path << "': " << std::strerror(errno) << '\n';
+    return false;
+  }
+  return true;
+}
+
+
+auto WriteAheadLog::replay(const replay_fn& replay) -> std::size_t
+{
+  struct stat info;
+  if (fd < 0 || ::fstat(fd, &info) != 0)
+    return 0;
+  std::string contents(info.st_size, '\0');
+  std::size_t loaded = 0;
+  while (loaded < contents.size()) {
+    const ssize_t got = ::pread(fd, contents.data() + loaded, contents.size() - loaded, loaded);
+    if (got <= 0)
+      break;
+    loaded += got;
+  }
+  contents.resize(loaded);
+
+  std::size_t offset = 0, replayed = 0;
+  while (offset + header_size <= contents.size()) {
+    const uint32_t length = get_u32(contents.data() + offset);
+    const uint32_t checksum = get_u32(contents.data() + offset + sizeof(uint32_t));
+    if (offset + header_size + length > contents.size())
+      break;
+    const std::string_view record(contents.data() + offset + header_size, length);
+    if (encoding::crc32(record) != checksum)
+      break;
+    replay(record);
+    offset += header_size + length;
+    ++replayed;
+  }
+  // a crash mid-write leaves a torn tail, new records must not be appended behind it
+  if (offset != contents.size()) {
+    std::clog << "[💥][WAL] dropping " << contents.size() - offset << " bytes of torn tail from '" << path << "'\n";
+    if (::ftruncate(fd, offset) != 0)
+      std::clog << "[❌][WAL] cannot truncate '" << path << "': " << std::strerror(errno) << '\n';
+  }
+  std::clog << "[✅][WAL] replayed " << replayed << " records from '" << path << "'\n";
+  return replayed;
+}
+
+
+void WriteAheadLog::start()
+{
+  committer = std::thread(&WriteAheadLog::committer_loop, this);
+}
+
+
+void WriteAheadLog::stop()
+{
+  {
+    std::unique_lock lock(mutex_queue);
+    stopping = true;
+  }
+  queue_condition.notify_all();
+  if (committer.joinable())
+    committer.join();
+}
+
+
+void WriteAheadLog::append(std::string record, durable_fn on_durable)
+{
+  {
+    std::unique_lock lock(mutex_queue);
+    queue.push_back({ std::move(record), std::move(on_durable) });
+  }
+  queue_condition.notify_one();
+}
+
+
+auto WriteAheadLog::rotate(const std::string& next) -> bool
+{
+  std::unique_lock lock(mutex_queue);
+  if (!committer.joinable()) {
+    lock.unlock();
+    return switch_to(next);
+  }
+  // one rotation at a time, a second caller waits for the first to be picked up
+  rotation_condition.wait(lock, [this] { return rotation.empty(); });
+  rotation = next;
+  const uint64_t target = rotations + 1;
+  queue_condition.notify_one();
+  rotation_condition.wait(lock, [this, target] { return rotations >= target; });
+  return rotated;
+}
+
+
+void WriteAheadLog::committer_loop()
+{
+  std::vector<Pending> batch;
+  std::unique_lock lock(mutex_queue);
+  while (true) {
+    queue_condition.wait(lock, [this] { return stopping || !queue.empty() || !rotation.empty(); });
+    if (queue.empty() && rotation.empty())
+      return;
+    if (linger > std::chrono::microseconds::zero() && !stopping && rotation.empty()) {
+      lock.unlock();
+      std::this_thread::sleep_for(linger);
+      lock.lock();
+    }
+    // everything queued while the previous round was syncing goes out in this one
+    batch.swap(queue);
+    const std::string next = rotation;
+    lock.unlock();
+    if (!batch.empty())
+      commit(batch);
+    batch.clear();
+    const bool switched = next.empty() || switch_to(next);
+    lock.lock();
+    if (!next.empty()) {
+      rotation.clear();
+      rotated = switched;
+      ++rotations;
+      rotation_condition.notify_all();
+    }
+  }
+}
+
+
+auto WriteAheadLog::switch_to(const std::string& next) -> bool
+{
+  const int next_fd = ::open(next.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (next_fd < 0) {
+    std::clog << "[❌][WAL] cannot open '" << next << "', staying on '" << path << "': " << std::strerror(errno) << '\n';
+    return false;
+  }
+  if (fd >= 0)
+    ::close(fd);
+  fd = next_fd;
+  path = next;
+  return true;
+}
+
+
+void WriteAheadLog::commit(std::vector<Pending>& batch)
+{
+  std::string buffer;
+  std::size_t size = 0;
+  for (const Pending& pending : batch)
+    size += header_size + pending.record.size();
+  buffer.reserve(size);
+  for (const Pending& pending : batch) {
+    put_u32(buffer, static_cast<uint32_t>(pending.record.size()));
+    put_u32(buffer, encoding::crc32(pending.record));
+    buffer += pending.record;
+  }
+
+  std::size_t written = 0;
+  while (written < buffer.size()) {
+    const ssize_t put = ::write(fd, buffer.data() + written, buffer.size() - written);
+    if (put < 0 && errno == EINTR)
+      continue;
+    if (put <= 0) {
+      // acknowledging would promise durability that does not exist, the state is no longer trustworthy
+      std::clog << "[❌][WAL] write to '" << path << "' failed: " << std::strerror(errno) << '\n';
+      std::abort();
+    }
+    written += put;
+  }
+  if (::fdatasync(fd) != 0) {
+    std::clog << "[❌][WAL] fdatasync of '" << path << "' failed: " << std::strerror(errno) << '\n';
+    std::abort();
+  }
+
+  counters.records += batch.size();
+  counters.bytes += buffer.size();
+  ++counters.batches;
+  for (Pending& pending : batch) {
+    if (pending.on_durable)
+      pending.on_durable();
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef COMMON_WAL_HEADER
+#define COMMON_WAL_HEADER
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// append-only write-ahead log file with group commit.
+// records are framed as [u32 length][u32 crc32][payload]. appenders only queue their record, a committer
+// thread writes everything queued since its last round with one write and one fdatasync, then runs each
+// record's `on_durable`, so a burst of appends costs a single sync.
+// replay stops at the first torn or corrupt frame and cuts the file back to the last good one.
+// `rotate` moves appends over to a new file: everything appended before it returns lands in the old one.
+class WriteAheadLog
+{
+public:
+  using durable_fn = std::function<void()>;
+  using replay_fn = std::function<void(std::string_view)>;
+
+  struct Stats {
+    std::atomic<uint64_t> records = 0;
+    std::atomic<uint64_t> batches = 0;
+    std::atomic<uint64_t> bytes   = 0;
+  };
+
+  // `linger` holds a round open that long after its first record, trading latency for bigger batches
+  explicit WriteAheadLog(std::chrono::microseconds linger = std::chrono::microseconds::zero());
+  ~WriteAheadLog();
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  auto operator=(const WriteAheadLog&) -> WriteAheadLog& = delete;
+
+  auto open(const std::string& path) -> bool;
+  // hands every intact record to `replay` in append order, only valid before `start`. the number replayed
+  auto replay(const replay_fn& replay) -> std::size_t;
+
+  void start();
+  // commits whatever is still queued, then joins the committer
+  void stop();
+
+  void append(std::string record, durable_fn on_durable);
+  // blocks until the committer has synced the current file and switched to `next`
+  auto rotate(const std::string& next) -> bool;
+
+  auto stats() const -> const Stats& { return counters; }
+
+private:
+  struct Pending {
+    std::string record;
+    durable_fn  on_durable;
+  };
+  void committer_loop();
+  void commit(std::vector<Pending>& batch);
+  auto switch_to(const std::string& next) -> bool;
+
+  const std::chrono::microseconds linger;
+  int                             fd;
+  std::string                     path;
+
+  std::mutex                      mutex_queue;
+  std::condition_variable         queue_condition;
+  std::vector<Pending>            queue;
+  bool                            stopping;
+  std::string                     rotation;
+  uint64_t                        rotations;
+  bool                            rotated;
+  std::condition_variable         rotation_condition;
+  std::thread                     committer;
+  Stats                           counters;
+};
+
+#endif
@@ -0,0 +1,358 @@
+#include "kafka.h"
+#include "common/epoch.h"
+#include "common/snowflake.h"
+#include <functional>
+#include <iostream>
+#include <mutex>
+
+
+Kafka::Kafka(Node& node)
+  : partitions(new PartitionDirectory())
+  , node(node)
+{
+  using namespace std::placeholders;
+  node.register_handler(SEND_REQ,                   std::bind(&Kafka::handle_send, this, _1));
+  node.register_handler(POLL_REQ,                   std::bind(&Kafka::handle_poll, this, _1));
+  node.register_handler(COMMIT_OFFSETS_REQ,         std::bind(&Kafka::handle_commit_offsets, this, _1));
+  node.register_handler(LIST_COMMITTED_OFFSETS_REQ, std::bind(&Kafka::handle_list_committed_offsets, this, _1));
+  node.register_handler(KAFKA_APPEND_REQ,           std::bind(&Kafka::handle_append, this, _1));
+  // with lanes or shards, all sends to one key land on the same worker and never contend for its partition
+  node.set_lane_key(SEND_REQ, [](const Message& msg) -> uint64_t {
+    if (!msg.body.contains("key") || !msg.body["key"].is_string())
+      return 0;
+    return std::hash<std::string>()(msg.body["key"].get_ref<const std::string&>());
+  });
+}
+
+
+Kafka::~Kafka()
+{
+  // nobody looks anything up anymore, the copies retired earlier are Epoch's to free
+  delete partitions.load();
+}
+
+
+auto Kafka::handle_send(const Message& msg) -> Message
+{
+  if (!msg.body.contains("key") || !msg.body["key"].is_string() || !msg.body.contains("msg")) {
+    std::clog << "[❓][KFK] send without 'key' or 'msg'\n";
+    return Message();
+  }
+  std::string key = msg.body["key"].get<std::string>();
+  if (const std::string& owner = owner_of(key); owner != node.node_id()) {
+    forward_send(owner, { std::move(key), msg.body["msg"], std::make_shared<Message>(msg) });
+    return Message();
+  }
+
+  Partition& partition = get_or_create_partition(key);
+  const int64_t offset = partition.log.append(msg.body["msg"]);
+
+  Message response = msg.create_response();
+  response.body["offset"] = offset;
+  return response;
+}
+
+
+auto Kafka::handle_poll(const Message& msg) -> Message
+{
+  if (!msg.body.contains("offsets") || !msg.body["offsets"].is_object()) {
+    std::clog << "[❓][KFK] poll without 'offsets'\n";
+    return Message();
+  }
+  return scatter(msg, "offsets", "msgs", std::bind(&Kafka::poll_local, this, std::placeholders::_1));
+}
+
+
+auto Kafka::handle_commit_offsets(const Message& msg) -> Message
+{
+  if (!msg.body.contains("offsets") || !msg.body["offsets"].is_object()) {
+    std::clog << "[❓][KFK] commit_offsets without 'offsets'\n";
+    return Message();
+  }
+  return scatter(msg, "offsets", nullptr, std::bind(&Kafka::commit_local, this, std::placeholders::_1));
+}
+
+
+auto Kafka::handle_list_committed_offsets(const Message& msg) -> Message
+{
+  if (!msg.body.contains("keys") || !msg.body["keys"].is_array()) {
+    std::clog << "[❓][KFK] list_committed_offsets without 'keys'\n";
+    return Message();
+  }
+  return scatter(msg, "keys", "offsets", std::bind(&Kafka::list_committed_local, this, std::placeholders::_1));
+}
+
+
+auto Kafka::handle_append(const Message& msg) -> Message
+{
+  if (!msg.body.contains("entries") || !msg.body["entries"].is_array()) {
+    std::clog << "[❓][KFK] kafka_append without 'entries'\n";
+    return Message();
+  }
+  const json& entries = msg.body["entries"];
+
+  // group the batch by key so each key takes its log lock once and gets one contiguous offset range
+  std::unordered_map<std::string, std::vector<std::size_t>> by_key;
+  for (std::size_t idx = 0; idx < entries.size(); ++idx) {
+    if (entries[idx].is_array() && entries[idx].size() == 2 && entries[idx][0].is_string())
+      by_key[entries[idx][0].get<std::string>()].push_back(idx);
+  }
+
+  json offsets = json::array();
+  for (std::size_t idx = 0; idx < entries.size(); ++idx)
+    offsets.push_back(-1);
+  for (auto& [key, indices] : by_key) {
+    std::vector<json> values;
+    values.reserve(indices.size());
+    for (std::size_t idx : indices)
+      values.push_back(entries[idx][1]);
+
+    const int64_t first = get_or_create_partition(key).log.append_batch(std::move(values));
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      offsets[indices[i]] = first + static_cast<int64_t>(i);
+  }
+
+  Message response = msg.create_response();
+  response.body["offsets"] = std::move(offsets);
+  return response;
+}
+
+
+auto Kafka::poll_local(const json& offsets) -> json
+{
+  json msgs = json::object();
+  for (const auto& [key, offset] : offsets.items()) {
+    if (!offset.is_number_integer())
+      continue;
+    Partition* partition = find_partition(key);
+    if (nullptr == partition)
+      continue;
+
+    json entries = json::array();
+    for (SegmentedLog::Entry& entry : partition->log.read_from(offset.get<int64_t>(), max_poll_entries))
+      entries.push_back(json::array({ entry.offset, std::move(entry.value) }));
+    msgs[key] = std::move(entries);
+  }
+  return msgs;
+}
+
+
+auto Kafka::commit_local(const json& offsets) -> json
+{
+  for (const auto& [key, offset] : offsets.items()) {
+    if (!offset.is_number_integer())
+      continue;
+    Partition* partition = find_partition(key);
+    if (nullptr == partition)
+      continue;
+
+    const int64_t requested = offset.get<int64_t>();
+    int64_t committed = partition->committed.load();
+    while (committed < requested && !partition->committed.compare_exchange_weak(committed, requested));
+    if (committed >= requested)
+      continue;
+
+    // a committed offset has been consumed, everything strictly below it can go
+    if (std::size_t freed = partition->log.reclaim_before(requested); freed > 0)
+      std::clog << "[♻️][KFK] reclaimed " << freed << " segment(s) of '" << key << "'\n";
+  }
+  return json::object();
+}
+
+
+auto Kafka::list_committed_local(const json& keys) -> json
+{
+  json offsets = json::object();
+  for (const json& key : keys) {
+    if (!key.is_string())
+      continue;
+    Partition* partition = find_partition(key.get<std::string>());
+    if (nullptr == partition)
+      continue;
+    if (int64_t committed = partition->committed.load(); committed >= 0)
+      offsets[key.get<std::string>()] = committed;
+  }
+  return offsets;
+}
+
+
+auto Kafka::find_partition(const std::string& key) -> Partition*
+{
+  // workers are online between their quiescent points already, any other thread is for the lookup
+  Epoch::Guard guard;
+  const PartitionDirectory& directory = *partitions.load(std::memory_order_acquire);
+  auto found = directory.find(key);
+  return found == directory.end() ? nullptr : found->second;
+}
+
+
+auto Kafka::get_or_create_partition(const std::string& key) -> Partition&
+{
+  if (Partition* partition = find_partition(key))
+    return *partition;
+
+  std::unique_lock lock(mutex_partitions);
+  PartitionDirectory* current = partitions.load(std::memory_order_relaxed);
+  if (auto found = current->find(key); found != current->end())
+    return *found->second;
+  owned_partitions.push_back(std::make_unique<Partition>());
+  PartitionDirectory* grown = new PartitionDirectory(*current);
+  grown->emplace(key, owned_partitions.back().get());
+  partitions.store(grown, std::memory_order_release);
+  // lookups may still be walking the old copy, it is freed once every worker has been quiescent since
+  Epoch::retire(current);
+  return *owned_partitions.back();
+}
+
+
+auto Kafka::owner_of(std::string_view key) -> const std::string&
+{
+  // node ids are only known after 'init', handlers never run before it
+  std::call_once(ring_built, [this] { ring = HashRing(node.node_ids()); });
+  return ring.owner(key);
+}
+
+
+auto Kafka::split_by_owner(const json& keys) -> std::unordered_map<std::string, json>
+{
+  std::unordered_map<std::string, json> shares;
+  if (keys.is_object()) {
+    for (const auto& [key, value] : keys.items()) {
+      json& share = shares[owner_of(key)];
+      if (share.is_null())
+        share = json::object();
+      share[key] = value;
+    }
+  } else {
+    for (const json& key : keys) {
+      if (!key.is_string())
+        continue;
+      shares[owner_of(key.get<std::string_view>())].push_back(key);
+    }
+  }
+  return shares;
+}
+
+
+auto Kafka::scatter(const Message& msg, const char* field, const char* result_field, local_fn local) -> Message
+{
+  std::unordered_map<std::string, json> shares = split_by_owner(msg.body[field]);
+  json local_result = json::object();
+  if (auto own = shares.find(std::string(node.node_id())); own != shares.end()) {
+    local_result = local(own->second);
+    shares.erase(own);
+  }
+
+  if (shares.empty()) {
+    Message response = msg.create_response();
+    if (nullptr != result_field)
+      response.body[result_field] = std::move(local_result);
+    return response;
+  }
+
+  struct Gather {
+    Gather(Message&& response, Message&& error, json&& merged, std::size_t remaining)
+      : response(std::move(response)), error(std::move(error)), merged(std::move(merged)), remaining(remaining)
+    {}
+
+    std::mutex  mutex;
+    Message     response;
+    Message     error;
+    json        merged;
+    std::size_t remaining;
+    // a share went unanswered, the client already got an error
+    bool        failed = false;
+  };
+  auto gather = std::make_shared<Gather>(msg.create_response(),
+    msg.create_error(ERR_TEMPORARILY_UNAVAILABLE, "an owning node did not answer"), std::move(local_result), shares.size());
+
+  for (auto& [owner, share] : shares) {
+    Message forwarded(msg.type, Snowflake::generate_64(), node.node_id(), owner);
+    forwarded.body[field] = std::move(share);
+    node.rpc(forwarded, [this, gather, result_field](const Message& reply) {
+      std::unique_lock lock(gather->mutex);
+      if (gather->failed) {
+        --gather->remaining;
+        return;
+      }
+      if (reply.type == ERROR_RES) {
+        gather->failed = true;
+        --gather->remaining;
+        lock.unlock();
+        std::clog << "[⚠️][KFK] '" << reply.from << "' did not answer a forwarded share, failing the request\n";
+        node.send(gather->error);
+        return;
+      }
+      if (nullptr != result_field && reply.body.contains(result_field) && reply.body[result_field].is_object())
+        gather->merged.update(reply.body[result_field]);
+      if (--gather->remaining != 0)
+        return;
+      if (nullptr != result_field)
+        gather->response.body[result_field] = std::move(gather->merged);
+      lock.unlock();
+      node.send(gather->response);
+    }, forward_timeout);
+  }
+  return Message();
+}
+
+
+void Kafka::forward_send(const std::string& owner, PendingSend&& pending)
+{
+  std::unique_lock lock(mutex_outboxes);
+  Outbox& outbox = outboxes[owner];
+  outbox.queued.emplace_back(std::move(pending));
+  if (outbox.in_flight)
+    return;  // picked up as soon as the in-flight batch is acknowledged
+  outbox.in_flight = true;
+  std::vector<PendingSend> batch = std::move(outbox.queued);
+  outbox.queued.clear();
+  lock.unlock();
+
+  send_batch(owner, std::move(batch));
+}
+
+
+void Kafka::send_batch(const std::string& owner, std::vector<PendingSend>&& batch)
+{
+  Message request(KAFKA_APPEND_REQ, Snowflake::generate_64(), node.node_id(), owner);
+  json entries = json::array();
+  for (const PendingSend& pending : batch)
+    entries.push_back(json::array({ pending.key, pending.value }));
+  request.body["entries"] = std::move(entries);
+
+  auto in_flight = std::make_shared<std::vector<PendingSend>>(std::move(batch));
+  node.rpc(request, [this, owner, in_flight](const Message& reply) {
+    const bool valid = reply.type == KAFKA_APPEND_RES && reply.body.contains("offsets") && reply.body["offsets"].is_array()
+                    && reply.body["offsets"].size() == in_flight->size();
+    if (!valid) {
+      std::clog << "[❌][KFK] no valid kafka_append_ok from '" << owner << "', failing " << in_flight->size() << " send(s)\n";
+      // only an error from the owner itself says the batch was not appended. after a timeout or a garbled
+      // acknowledgement it may well have been, the clients must not be told otherwise
+      const int code = reply.type == ERROR_RES && reply.body.contains("code") && reply.body["code"].is_number_integer()
+        ? reply.body["code"].get<int>() : ERR_CRASH;
+      const bool definite = reply.type == ERROR_RES && code != ERR_TIMEOUT && code != ERR_CRASH;
+      for (const PendingSend& pending : *in_flight) {
+        node.send(definite ? pending.request->create_error(ERR_TEMPORARILY_UNAVAILABLE, "owning node refused the send")
+          : code == ERR_TIMEOUT ? pending.request->create_error(ERR_TIMEOUT, "owning node did not acknowledge the send in time")
+          : pending.request->create_error(ERR_CRASH, "owning node sent no valid acknowledgement"));
+      }
+    }
+    for (std::size_t idx = 0; valid && idx < in_flight->size(); ++idx) {
+      Message response = (*in_flight)[idx].request->create_response();
+      response.body["offset"] = reply.body["offsets"][idx];
+      node.send(response);
+    }
+
+    std::unique_lock lock(mutex_outboxes);
+    Outbox& outbox = outboxes[owner];
+    if (outbox.queued.empty()) {
+      outbox.in_flight = false;
+      return;
+    }
+    std::vector<PendingSend> next = std::move(outbox.queued);
+    outbox.queued.clear();
+    lock.unlock();
+    send_batch(owner, std::move(next));
+  }, forward_timeout);
+}
@@ -0,0 +1,92 @@
+#ifndef KAFKA_KAFKA_HEADER
+#define KAFKA_KAFKA_HEADER
+#include "segmented_log.h"
+#include "common/hash_ring.h"
+#include "common/message.h"
+#include "common/node.h"
+#include "ext/nlohmann/json.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// handlers for maelstrom's kafka workload: send, poll, commit_offsets and list_committed_offsets.
+// keys are sharded over all nodes with a consistent hash ring, each key's log only lives on its owner.
+// sends for foreign keys are forwarded to the owner in batches, at most one batch in flight per owner,
+// everything queued up while a batch is in flight goes out together once it is acknowledged.
+// a forwarded send the owner does not acknowledge within `forward_timeout` is answered with a timeout, it may
+// have been appended all the same. a scattered read or offset update that goes unanswered fails with error 11.
+class Kafka
+{
+  using json = nlohmann::json;
+public:
+  explicit Kafka(Node& node);
+  ~Kafka();
+
+  static constexpr std::size_t segment_capacity = 1024;
+  static constexpr std::size_t max_poll_entries = 256;
+  static constexpr std::chrono::milliseconds forward_timeout = std::chrono::milliseconds(500);
+
+private:
+  auto handle_send(const Message& msg) -> Message;
+  auto handle_poll(const Message& msg) -> Message;
+  auto handle_commit_offsets(const Message& msg) -> Message;
+  auto handle_list_committed_offsets(const Message& msg) -> Message;
+  auto handle_append(const Message& msg) -> Message;
+
+  auto poll_local(const json& offsets) -> json;
+  auto commit_local(const json& offsets) -> json;
+  auto list_committed_local(const json& keys) -> json;
+
+private:
+  struct Partition {
+    Partition() : log(segment_capacity), committed(-1) {}
+
+    SegmentedLog          log;
+    std::atomic<int64_t>  committed;
+  };
+  // every send and poll looks its partition up, new keys are rare: lookups load the published directory
+  // without a lock, a new key publishes a grown copy and retires the old one to `Epoch`.
+  // partitions themselves are never removed, a pointer to one stays valid for the lifetime of `Kafka`
+  using PartitionDirectory = std::unordered_map<std::string, Partition*>;
+  auto find_partition(const std::string& key) -> Partition*;
+  auto get_or_create_partition(const std::string& key) -> Partition&;
+
+  std::atomic<PartitionDirectory*>        partitions;
+  std::mutex                              mutex_partitions;
+  std::vector<std::unique_ptr<Partition>> owned_partitions;
+
+private:
+  auto owner_of(std::string_view key) -> const std::string&;
+  auto split_by_owner(const json& keys) -> std::unordered_map<std::string, json>;
+
+  using local_fn = std::function<json(const json&)>;
+  // answers the locally owned share of `field` through `local` and forwards the other shares to their owners,
+  // the `result_field` objects of every share are merged into one response
+  auto scatter(const Message& msg, const char* field, const char* result_field, local_fn local) -> Message;
+
+  struct PendingSend {
+    std::string               key;
+    json                      value;
+    std::shared_ptr<Message>  request;
+  };
+  struct Outbox {
+    std::vector<PendingSend>  queued;
+    bool                      in_flight = false;
+  };
+  void forward_send(const std::string& owner, PendingSend&& pending);
+  void send_batch(const std::string& owner, std::vector<PendingSend>&& batch);
+
+  Node&                                   node;
+  std::once_flag                          ring_built;
+  HashRing                                ring;
+
+  std::mutex                              mutex_outboxes;
+  std::unordered_map<std::string, Outbox> outboxes;
+};
+
+#endif
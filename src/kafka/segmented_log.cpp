@@ -0,0 +1,105 @@
+#include "segmented_log.h"
+#include <algorithm>
+#include <mutex>
+
+
+SegmentedLog::SegmentedLog(std::size_t segment_capacity)
+  : segment_capacity(segment_capacity == 0 ? 1 : segment_capacity)
+  , next(0)
+{}
+
+
+auto SegmentedLog::append(json value) -> int64_t
+{
+  std::unique_lock lock(mutex);
+  return append_locked(std::move(value));
+}
+
+
+auto SegmentedLog::append_batch(std::vector<json>&& values) -> int64_t
+{
+  std::unique_lock lock(mutex);
+  const int64_t first = next;
+  for (json& value : values)
+    append_locked(std::move(value));
+  return first;
+}
+
+
+auto SegmentedLog::append_locked(json&& value) -> int64_t
+{
+  if (segments.empty() || segments.back()->values.size() == segment_capacity) {
+    auto segment = std::make_unique<Segment>();
+    segment->base_offset = next;
+    segment->values.reserve(segment_capacity);
+    segments.emplace_back(std::move(segment));
+  }
+  segments.back()->values.emplace_back(std::move(value));
+  return next++;
+}
+
+
+auto SegmentedLog::read_from(int64_t offset, std::size_t max_entries) const -> std::vector<Entry>
+{
+  std::vector<Entry> out;
+  std::shared_lock lock(mutex);
+  if (segments.empty() || offset >= next)
+    return out;
+
+  offset = std::max(offset, segments.front()->base_offset);
+  out.reserve(std::min<std::size_t>(max_entries, next - offset));
+  for (std::size_t seg_idx = find_segment(offset); seg_idx < segments.size() && out.size() < max_entries; ++seg_idx) {
+    const Segment& segment = *segments[seg_idx];
+    std::size_t idx = offset - segment.base_offset;
+    for (; idx < segment.values.size() && out.size() < max_entries; ++idx)
+      out.push_back({ segment.base_offset + static_cast<int64_t>(idx), segment.values[idx] });
+    offset = segment.base_offset + segment.values.size();
+  }
+  return out;
+}
+
+
+auto SegmentedLog::reclaim_before(int64_t offset) -> std::size_t
+{
+  std::unique_lock lock(mutex);
+  std::size_t reclaimed = 0;
+  // the tail segment is kept around even when fully committed, it is still being appended to
+  while (segments.size() > 1) {
+    const Segment& front = *segments.front();
+    if (front.base_offset + static_cast<int64_t>(front.values.size()) > offset)
+      break;
+    segments.pop_front();
+    ++reclaimed;
+  }
+  return reclaimed;
+}
+
+
+auto SegmentedLog::next_offset() const -> int64_t
+{
+  std::shared_lock lock(mutex);
+  return next;
+}
+
+
+auto SegmentedLog::first_offset() const -> int64_t
+{
+  std::shared_lock lock(mutex);
+  return segments.empty() ? next : segments.front()->base_offset;
+}
+
+
+auto SegmentedLog::segment_count() const -> std::size_t
+{
+  std::shared_lock lock(mutex);
+  return segments.size();
+}
+
+
+auto SegmentedLog::find_segment(int64_t offset) const -> std::size_t
+{
+  // first segment whose base is past the offset, the one before it holds the offset
+  auto found = std::upper_bound(segments.begin(), segments.end(), offset,
+    [](int64_t off, const std::unique_ptr<Segment>& segment) { return off < segment->base_offset; });
+  return found == segments.begin() ? 0 : std::distance(segments.begin(), found) - 1;
+}
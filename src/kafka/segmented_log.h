@@ -0,0 +1,51 @@
+#ifndef KAFKA_SEGMENTED_LOG_HEADER
+#define KAFKA_SEGMENTED_LOG_HEADER
+#include "ext/nlohmann/json.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+// append-only log of a single kafka key.
+// entries live in fixed-size segments that are never reallocated once created, the segment list
+// is ordered by base offset so a poll is a binary search over segments plus a contiguous copy.
+// memory is given back a whole segment at a time once every offset in it has been committed.
+class SegmentedLog
+{
+  using json = nlohmann::json;
+public:
+  struct Entry {
+    int64_t offset;
+    json    value;
+  };
+
+  explicit SegmentedLog(std::size_t segment_capacity = 1024);
+
+  auto append(json value) -> int64_t;
+  // assigns one contiguous offset range to the whole batch, returns the first offset of it
+  auto append_batch(std::vector<json>&& values) -> int64_t;
+  auto read_from(int64_t offset, std::size_t max_entries) const -> std::vector<Entry>;
+  // drops every segment that only holds offsets below `offset`, returns how many were dropped
+  auto reclaim_before(int64_t offset) -> std::size_t;
+
+  auto next_offset() const    -> int64_t;
+  auto first_offset() const   -> int64_t;
+  auto segment_count() const  -> std::size_t;
+
+private:
+  struct Segment {
+    int64_t           base_offset;
+    std::vector<json> values;
+  };
+
+  auto append_locked(json&& value) -> int64_t;
+  auto find_segment(int64_t offset) const -> std::size_t;
+
+  const std::size_t                     segment_capacity;
+  mutable std::shared_mutex             mutex;
+  std::deque<std::unique_ptr<Segment>>  segments;
+  int64_t                               next;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "kv_client.h"
+#include "common/snowflake.h"
+#include <algorithm>
+#include <iostream>
+
+
+KVClient::KVClient(Node& node, std::string_view service)
+  : node(node)
+  , service(service)
+  , in_flight(0)
+{}
+
+
+void KVClient::read(const json& key, reply_fn done)
+{
+  std::string key_id = key.dump();
+  std::unique_lock lock(mutex_reads);
+  ReadWaiters& waiters = reads[key_id];
+  if (!waiters.current.empty()) {
+    waiters.next.emplace_back(std::move(done));
+    return;
+  }
+  waiters.current.emplace_back(std::move(done));
+  lock.unlock();
+  send_read(key_id, key);
+}
+
+
+void KVClient::write(const json& key, json value, reply_fn done)
+{
+  Message msg(WRITE_REQ, Snowflake::generate_64(), node.node_id(), service);
+  msg.body["key"] = key;
+  msg.body["value"] = std::move(value);
+  request(std::move(msg), std::move(done));
+}
+
+
+void KVClient::cas(const json& key, json from, json to, bool create_if_not_exists, reply_fn done)
+{
+  Message msg(CAS_REQ, Snowflake::generate_64(), node.node_id(), service);
+  msg.body["key"] = key;
+  msg.body["from"] = std::move(from);
+  msg.body["to"] = std::move(to);
+  if (create_if_not_exists)
+    msg.body["create_if_not_exists"] = true;
+  request(std::move(msg), std::move(done));
+}
+
+
+void KVClient::update(const json& key, update_fn fn, reply_fn done)
+{
+  update_attempt(key, std::move(fn), std::move(done), 0);
+}
+
+
+void KVClient::update_attempt(const json& key, update_fn fn, reply_fn done, int attempt)
+{
+  read(key, [this, key, fn, done, attempt](const Reply& current) {
+    if (!current.ok() && current.error != ERR_KEY_DOES_NOT_EXIST) {
+      done(current);
+      return;
+    }
+    const bool exists = current.ok();
+    json from = exists ? current.value : json();
+    json to = fn(from);
+    cas(key, from, to, !exists, [this, key, fn, done, attempt, to](const Reply& swapped) {
+      if (swapped.ok()) {
+        done({ std::nullopt, to });
+        return;
+      }
+      const bool lost_race = swapped.error == ERR_PRECONDITION_FAILED
+                          || swapped.error == ERR_KEY_DOES_NOT_EXIST
+                          || swapped.error == ERR_KEY_ALREADY_EXISTS;
+      if (!lost_race || attempt + 1 >= max_attempts) {
+        done(swapped);
+        return;
+      }
+      node.schedule(backoff_for(attempt), [this, key, fn, done, attempt] {
+        update_attempt(key, fn, done, attempt + 1);
+      });
+    });
+  });
+}
+
+
+void KVClient::send_read(const std::string& key_id, const json& key)
+{
+  Message msg(READ_REQ, Snowflake::generate_64(), node.node_id(), service);
+  msg.body["key"] = key;
+  request(std::move(msg), [this, key_id, key](const Reply& reply) {
+    std::unique_lock lock(mutex_reads);
+    ReadWaiters& waiters = reads[key_id];
+    std::vector<reply_fn> finished = std::move(waiters.current);
+    waiters.current = std::move(waiters.next);
+    waiters.next.clear();
+    const bool read_again = !waiters.current.empty();
+    if (!read_again)
+      reads.erase(key_id);
+    lock.unlock();
+
+    for (reply_fn& done : finished)
+      done(reply);
+    if (read_again)
+      send_read(key_id, key);
+  });
+}
+
+
+void KVClient::request(Message&& msg, reply_fn done, int attempt)
+{
+  std::unique_lock lock(mutex_pipeline);
+  if (in_flight >= max_in_flight) {
+    queued.push_back({ std::move(msg), std::move(done), attempt });
+    return;
+  }
+  ++in_flight;
+  lock.unlock();
+  send_now(std::move(msg), std::move(done), attempt);
+}
+
+
+void KVClient::send_now(Message&& msg, reply_fn done, int attempt)
+{
+  auto sent = std::make_shared<Message>(std::move(msg));
+  node.rpc(*sent, [this, sent, done, attempt](const Message& response) {
+    {
+      std::unique_lock lock(mutex_pipeline);
+      --in_flight;
+    }
+    flush_queued();
+
+    Reply reply = to_reply(response);
+    if (is_transient(reply) && attempt + 1 < max_attempts) {
+      node.schedule(backoff_for(attempt), [this, sent, done, attempt] {
+        // a retry is a new request as far as the service is concerned
+        Message retry(sent->type, Snowflake::generate_64(), sent->from, sent->to);
+        json body = sent->body;
+        body["msg_id"] = retry.id.as_json();
+        retry.body = std::move(body);
+        request(std::move(retry), done, attempt + 1);
+      });
+      return;
+    }
+    done(reply);
+  }, rpc_timeout);
+}
+
+
+void KVClient::flush_queued()
+{
+  std::unique_lock lock(mutex_pipeline);
+  while (in_flight < max_in_flight && !queued.empty()) {
+    Queued next = std::move(queued.front());
+    queued.pop_front();
+    ++in_flight;
+    lock.unlock();
+    send_now(std::move(next.msg), std::move(next.done), next.attempt);
+    lock.lock();
+  }
+}
+
+
+auto KVClient::backoff_for(int attempt) const -> std::chrono::milliseconds
+{
+  const auto ceiling = std::min<int64_t>(max_backoff.count(), base_backoff.count() << std::min(attempt, 20));
+  // "equal jitter", half of the window is guaranteed so retries do spread out
+  const int64_t floor = ceiling / 2;
+  const int64_t spread = std::max<int64_t>(ceiling, 1) - floor + 1;
+  return std::chrono::milliseconds(floor + static_cast<int64_t>(node.random() % spread));
+}
+
+
+auto KVClient::to_reply(const Message& msg) -> Reply
+{
+  Reply reply;
+  if (msg.type == ERROR_RES) {
+    reply.error = msg.body.contains("code") && msg.body["code"].is_number_integer()
+      ? static_cast<ErrorCode>(msg.body["code"].get<int>())
+      : ERR_CRASH;
+    if (msg.body.contains("text"))
+      reply.value = msg.body["text"];
+    return reply;
+  }
+  if (msg.body.contains("value"))
+    reply.value = msg.body["value"];
+  return reply;
+}
+
+
+auto KVClient::is_transient(const Reply& reply) -> bool
+{
+  return reply.error == ERR_TEMPORARILY_UNAVAILABLE;
+}
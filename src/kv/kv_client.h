@@ -0,0 +1,85 @@
+#ifndef KV_KV_CLIENT_HEADER
+#define KV_KV_CLIENT_HEADER
+#include "common/message.h"
+#include "common/node.h"
+#include "ext/nlohmann/json.hpp"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// client for maelstrom's provided kv services (lin-kv, seq-kv, lww-kv).
+// every call is asynchronous, up to `max_in_flight` requests are pipelined to the service and the rest
+// wait locally. reads of a key that already has a read in flight are coalesced: everyone arriving while
+// it is out shares the single follow-up read, which is only sent once the first one returns so no
+// caller ever observes a value older than its own invocation.
+class KVClient
+{
+  using json = nlohmann::json;
+public:
+  static constexpr std::string_view LIN_KV = "lin-kv";
+  static constexpr std::string_view SEQ_KV = "seq-kv";
+  static constexpr std::string_view LWW_KV = "lww-kv";
+
+  struct Reply {
+    std::optional<ErrorCode>  error;
+    json                      value;
+
+    auto ok() const -> bool { return !error.has_value(); }
+  };
+  using reply_fn = std::function<void(const Reply&)>;
+  // computes the value to store from the current one, null if the key does not exist yet
+  using update_fn = std::function<json(const json& current)>;
+
+  KVClient(Node& node, std::string_view service);
+
+  void read(const json& key, reply_fn done);
+  void write(const json& key, json value, reply_fn done);
+  void cas(const json& key, json from, json to, bool create_if_not_exists, reply_fn done);
+  // read-modify-cas loop, a lost cas race is retried with jittered exponential backoff
+  void update(const json& key, update_fn fn, reply_fn done);
+
+  std::chrono::milliseconds rpc_timeout   = std::chrono::milliseconds(1000);
+  std::size_t               max_in_flight = 256;
+  int                       max_attempts  = 8;
+  std::chrono::milliseconds base_backoff  = std::chrono::milliseconds(2);
+  std::chrono::milliseconds max_backoff   = std::chrono::milliseconds(200);
+
+private:
+  // sends through the pipeline, 'temporarily unavailable' is a definite no-op on the service side so it is retried
+  void request(Message&& msg, reply_fn done, int attempt = 0);
+  void send_now(Message&& msg, reply_fn done, int attempt);
+  void flush_queued();
+  void send_read(const std::string& key_id, const json& key);
+  void update_attempt(const json& key, update_fn fn, reply_fn done, int attempt);
+  auto backoff_for(int attempt) const -> std::chrono::milliseconds;
+  static auto to_reply(const Message& msg) -> Reply;
+  static auto is_transient(const Reply& reply) -> bool;
+
+private:
+  Node&       node;
+  std::string service;
+
+  struct Queued {
+    Message   msg;
+    reply_fn  done;
+    int       attempt;
+  };
+  std::mutex          mutex_pipeline;
+  std::size_t         in_flight;
+  std::deque<Queued>  queued;
+
+  struct ReadWaiters {
+    std::vector<reply_fn> current;
+    std::vector<reply_fn> next;
+  };
+  std::mutex                                    mutex_reads;
+  std::unordered_map<std::string, ReadWaiters>  reads;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "local_service.h"
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <random>
+
+namespace {
+  using json = nlohmann::json;
+
+  auto rng() -> std::mt19937_64&
+  {
+    thread_local std::mt19937_64 gen{ std::random_device()() };
+    return gen;
+  }
+
+  struct Applied {
+    Message             reply;
+    std::optional<json> next;
+  };
+
+  // read/write/cas against the current value of one key, `current` is null if the key does not exist
+  auto apply_op(const Message& request, const json* current) -> Applied
+  {
+    switch (request.type) {
+      case READ_REQ: {
+        if (nullptr == current)
+          return { request.create_error(ERR_KEY_DOES_NOT_EXIST, "key does not exist"), std::nullopt };
+        Message reply = request.create_response();
+        reply.body["value"] = *current;
+        return { std::move(reply), std::nullopt };
+      }
+      case WRITE_REQ:
+        if (!request.body.contains("value"))
+          return { request.create_error(ERR_MALFORMED_REQUEST, "write without 'value'"), std::nullopt };
+        return { request.create_response(), std::optional<json>(std::in_place, request.body["value"]) };
+      case CAS_REQ: {
+        if (!request.body.contains("from") || !request.body.contains("to"))
+          return { request.create_error(ERR_MALFORMED_REQUEST, "cas without 'from' or 'to'"), std::nullopt };
+        if (nullptr == current) {
+          const bool create = request.body.contains("create_if_not_exists") && request.body["create_if_not_exists"] == true;
+          if (!create)
+            return { request.create_error(ERR_KEY_DOES_NOT_EXIST, "key does not exist"), std::nullopt };
+          return { request.create_response(), std::optional<json>(std::in_place, request.body["to"]) };
+        }
+        if (*current != request.body["from"])
+          return { request.create_error(ERR_PRECONDITION_FAILED, "expected " + request.body["from"].dump() + ", had " + current->dump()), std::nullopt };
+        return { request.create_response(), std::optional<json>(std::in_place, request.body["to"]) };
+      }
+      default:
+        break;
+    }
+    return { request.create_error(ERR_NOT_SUPPORTED, "unsupported kv operation"), std::nullopt };
+  }
+}
+
+
+LocalKVService::LocalKVService(Node& node, std::string_view name, Semantics semantics, Config config)
+  : node(node)
+  , name(name)
+  , semantics(semantics)
+  , config(config)
+  , seq(0)
+  , clock(0)
+  , replicas(std::max(config.lww_replicas, 1))
+{
+  node.register_local_service(name, std::bind(&LocalKVService::receive, this, std::placeholders::_1));
+}
+
+
+auto LocalKVService::handle(const Message& request) -> Message
+{
+  if (!request.body.contains("key"))
+    return request.create_error(ERR_MALFORMED_REQUEST, "request without 'key'");
+  switch (semantics) {
+    case LINEARIZABLE:    return handle_linearizable(request);
+    case SEQUENTIAL:      return handle_sequential(request);
+    case LAST_WRITE_WINS: return handle_lww(request);
+  }
+  return request.create_error(ERR_CRASH, "unknown kv semantics");
+}
+
+
+void LocalKVService::receive(const Message& request)
+{
+  if (roll(config.drop_rate)) {
+    std::clog << "[💥][LKV] '" << name << "' dropped request\n";
+    return;
+  }
+  node.schedule(delay(), [this, request] {
+    Message reply = roll(config.fail_rate)
+      ? request.create_error(ERR_TEMPORARILY_UNAVAILABLE, "injected failure")
+      : handle(request);
+    if (roll(config.lose_reply_rate)) {
+      std::clog << "[💥][LKV] '" << name << "' lost reply\n";
+      return;
+    }
+    node.deliver(std::move(reply));
+  });
+}
+
+
+auto LocalKVService::handle_linearizable(const Message& request) -> Message
+{
+  const std::string key = request.body["key"].dump();
+  std::unique_lock lock(mutex);
+  auto found = store.find(key);
+  Applied applied = apply_op(request, found == store.end() ? nullptr : &found->second);
+  if (applied.next.has_value())
+    store.insert_or_assign(key, std::move(applied.next.value()));
+  return std::move(applied.reply);
+}
+
+
+auto LocalKVService::handle_sequential(const Message& request) -> Message
+{
+  const std::string key = request.body["key"].dump();
+  std::unique_lock lock(mutex);
+  uint64_t& floor = client_floor[request.from];
+  std::vector<Version>& versions = history[key];
+
+  // reads observe the store as of some point between the client's last observation and now,
+  // writes always go against the latest state
+  uint64_t at = seq;
+  if (request.type == READ_REQ) {
+    at = std::uniform_int_distribution<uint64_t>(floor, seq)(rng());
+    // older versions are pruned, never pretend a key did not exist when its history was cut short
+    if (versions.size() == max_history)
+      at = std::max(at, versions.front().seq);
+  }
+  floor = at;
+
+  const json* current = nullptr;
+  for (auto it = versions.rbegin(); it != versions.rend(); ++it) {
+    if (it->seq <= at) {
+      current = &it->value;
+      break;
+    }
+  }
+  Applied applied = apply_op(request, current);
+  if (applied.next.has_value()) {
+    versions.push_back({ ++seq, std::move(applied.next.value()) });
+    if (versions.size() > max_history)
+      versions.erase(versions.begin());
+    floor = seq;
+  }
+  return std::move(applied.reply);
+}
+
+
+auto LocalKVService::handle_lww(const Message& request) -> Message
+{
+  const std::string key = request.body["key"].dump();
+  const std::size_t replica = std::uniform_int_distribution<std::size_t>(0, replicas.size() - 1)(rng());
+  std::unique_lock lock(mutex);
+  auto found = replicas[replica].find(key);
+  Applied applied = apply_op(request, found == replicas[replica].end() ? nullptr : &found->second.value);
+  if (!applied.next.has_value())
+    return std::move(applied.reply);
+
+  Stamped stamped { std::move(applied.next.value()), ++clock };
+  replicas[replica].insert_or_assign(key, stamped);
+  lock.unlock();
+
+  node.schedule(config.propagation, [this, key, replica, stamped] {
+    std::unique_lock lock(mutex);
+    for (std::size_t other = 0; other < replicas.size(); ++other) {
+      if (other == replica)
+        continue;
+      auto [it, inserted] = replicas[other].try_emplace(key, stamped);
+      if (!inserted && it->second.stamp < stamped.stamp)
+        it->second = stamped;
+    }
+  });
+  return std::move(applied.reply);
+}
+
+
+auto LocalKVService::roll(double rate) -> bool
+{
+  return rate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(rng()) < rate;
+}
+
+
+auto LocalKVService::delay() -> std::chrono::microseconds
+{
+  if (config.jitter.count() <= 0)
+    return config.latency;
+  return config.latency + std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, config.jitter.count())(rng()));
+}
@@ -0,0 +1,87 @@
+#ifndef KV_LOCAL_SERVICE_HEADER
+#define KV_LOCAL_SERVICE_HEADER
+#include "common/message.h"
+#include "common/node.h"
+#include "ext/nlohmann/json.hpp"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// in-process stand-in for maelstrom's lin-kv, seq-kv and lww-kv services.
+// it hooks into the node as a local service, so requests never leave the process and replies come back
+// through Node::deliver exactly like they would from stdin, which lets kv-dependent handlers be
+// benchmarked without the maelstrom harness.
+class LocalKVService
+{
+  using json = nlohmann::json;
+public:
+  enum Semantics {
+    LINEARIZABLE,
+    // every client sees a monotonically advancing, possibly stale snapshot of the store
+    SEQUENTIAL,
+    // independent replicas, a write lands on one of them and reaches the others after `propagation`
+    LAST_WRITE_WINS,
+  };
+
+  struct Config {
+    std::chrono::microseconds latency     = std::chrono::microseconds(0);
+    std::chrono::microseconds jitter      = std::chrono::microseconds(0);
+    std::chrono::microseconds propagation = std::chrono::microseconds(1000);
+    // replies 'temporarily unavailable' without touching the store
+    double                    fail_rate   = 0.0;
+    // request vanishes before it is applied
+    double                    drop_rate   = 0.0;
+    // request is applied but its reply vanishes, the client only sees a timeout
+    double                    lose_reply_rate = 0.0;
+    int                       lww_replicas = 3;
+  };
+
+  LocalKVService(Node& node, std::string_view name, Semantics semantics, Config config);
+
+  // executes one request synchronously, without latency or failure injection
+  auto handle(const Message& request) -> Message;
+
+private:
+  void receive(const Message& request);
+
+  auto handle_linearizable(const Message& request) -> Message;
+  auto handle_sequential(const Message& request) -> Message;
+  auto handle_lww(const Message& request) -> Message;
+
+  auto roll(double rate) -> bool;
+  auto delay() -> std::chrono::microseconds;
+
+private:
+  Node&             node;
+  const std::string name;
+  const Semantics   semantics;
+  const Config      config;
+
+  std::mutex        mutex;
+
+  // LINEARIZABLE
+  std::unordered_map<std::string, json> store;
+
+  // SEQUENTIAL
+  struct Version {
+    uint64_t  seq;
+    json      value;
+  };
+  uint64_t                                              seq;
+  std::unordered_map<std::string, std::vector<Version>> history;
+  std::unordered_map<std::string, uint64_t>             client_floor;
+  static constexpr std::size_t                          max_history = 16;
+
+  // LAST_WRITE_WINS
+  struct Stamped {
+    json      value;
+    uint64_t  stamp;
+  };
+  uint64_t                                              clock;
+  std::vector<std::unordered_map<std::string, Stamped>> replicas;
+};
+
+#endif
@@ -1,9 +1,77 @@
+#include "common/affinity.h"
+#include "common/event_loop.h"
 #include "common/message.h"
 #include "common/node.h"
+#include "common/options.h"
 #include "common/snowflake.h"
+#include "common/trace.h"
+#include "kafka/kafka.h"
+#include "kv/local_service.h"
+#include "raft/raft.h"
+#include "txn/txn.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+#include <vector>
 
 int main(int argc, const char** argv) {
-  Node node(16);
+  Options options(argc, argv);
+  // --workers sizes the pool, one per cpu the process may run on unless given
+  Node node(std::max(1L, options.get_int("workers", static_cast<long>(Affinity::allowed_cpus().size()))));
+  if (std::optional<std::string_view> trace = options.get("trace"); trace.has_value())
+    Trace::enable(std::string(trace.value()), options.get_int("trace-sample", 1));
+  if (std::optional<std::string_view> wal_dir = options.get("wal-dir"); wal_dir.has_value())
+    node.enable_wal(std::string(wal_dir.value()), options.get_int("wal-checkpoint-every", 0));
+  // --queue-limit bounds the requests waiting for a worker, --queue-policy picks what happens once it is reached
+  if (options.has("queue-limit")) {
+    const std::string_view policy = options.get("queue-policy").value_or("reject");
+    node.set_queue_limit(options.get_int("queue-limit", 0), policy == "block" ? Node::BLOCK
+      : policy == "shed-oldest" ? Node::SHED_OLDEST
+      : Node::REJECT);
+  }
+  // --lanes runs requests from the same sender one at a time, in the order they arrived
+  if (options.has("lanes"))
+    node.enable_lanes(std::max(1L, options.get_int("lanes", 1)));
+  // --shards turns every worker into a shard pinned to its own core, requests are routed by sender.
+  // --shard-ring sizes the ring between each producer and shard
+  if (options.has("shards"))
+    node.enable_shards(options.get_int("shard-ring", 256));
+  // --reader-cpu pins the reader and timer thread, --worker-cpus=0-3,8 pins the workers round-robin over the list
+  if (options.has("reader-cpu") || options.has("worker-cpus")) {
+    std::optional<int> reader_cpu;
+    if (options.has("reader-cpu"))
+      reader_cpu = options.get_int("reader-cpu", 0);
+    std::optional<std::vector<int>> worker_cpus = Affinity::parse_cpu_list(options.get("worker-cpus").value_or(""));
+    if (options.has("worker-cpus") && !worker_cpus.has_value()) {
+      std::clog << "[❌][SYS] cannot parse --worker-cpus\n";
+      return 1;
+    }
+    node.set_placement(reader_cpu, worker_cpus.value_or(std::vector<int>()));
+  }
+  // --idle=spin|spin-yield|spin-park keeps idle workers polling for up to --idle-spin-us instead of sleeping right away
+  if (std::optional<std::string_view> idle = options.get("idle"); idle.has_value()) {
+    const std::chrono::microseconds spin(options.get_int("idle-spin-us", 50));
+    node.set_idle_strategy(idle == "spin" ? Node::BUSY_SPIN
+      : idle == "spin-yield" ? Node::SPIN_YIELD
+      : idle == "spin-park" ? Node::SPIN_PARK
+      : Node::PARK, spin);
+  }
+  // --listen serves a single client over a unix socket instead of stdin/stdout, e.g. for soak tests
+  if (std::optional<std::string_view> path = options.get("listen"); path.has_value()) {
+    std::unique_ptr<SocketTransport> socket = SocketTransport::listen(std::string(path.value()));
+    if (!socket)
+      return 1;
+    node.set_transport(std::move(socket));
+  }
+  // --io=uring runs stdin, stdout and the timers on one io_uring loop, falling back to epoll. --io=epoll skips io_uring
+  if (std::optional<std::string_view> io = options.get("io"); io == "uring" || io == "epoll") {
+    std::unique_ptr<EventLoopTransport> loop = EventLoopTransport::create(STDIN_FILENO, STDOUT_FILENO, io == "uring");
+    if (!loop)
+      return 1;
+    node.set_transport(std::move(loop));
+  }
 
   node.register_handler(ECHO_REQ, [](const Message& msg) -> Message {
     Message response = msg.create_response();
@@ -17,5 +85,31 @@ int main(int argc, const char** argv) {
     return response;
   });
 
+  Kafka kafka(node);
+
+  Raft::Config raft_config;
+  raft_config.lease_reads = !options.has("raft-read-index");
+  raft_config.snapshot_threshold = options.get_int("raft-snapshot-threshold", raft_config.snapshot_threshold);
+  Raft raft(node, raft_config);
+
+  Txn::Config txn_config;
+  if (options.get("txn-isolation") == "read-committed")
+    txn_config.isolation = MVCCStore::READ_COMMITTED;
+  Txn txn(node, txn_config);
+
+  // --local-kv answers lin-kv/seq-kv/lww-kv in-process, for benchmarking without the maelstrom harness
+  std::vector<std::unique_ptr<LocalKVService>> local_kv;
+  if (options.has("local-kv")) {
+    LocalKVService::Config config;
+    config.latency          = std::chrono::microseconds(options.get_int("kv-latency-us", 0));
+    config.jitter           = std::chrono::microseconds(options.get_int("kv-jitter-us", 0));
+    config.fail_rate        = options.get_double("kv-fail-rate", 0.0);
+    config.drop_rate        = options.get_double("kv-drop-rate", 0.0);
+    config.lose_reply_rate  = options.get_double("kv-lose-reply-rate", 0.0);
+    local_kv.emplace_back(std::make_unique<LocalKVService>(node, "lin-kv", LocalKVService::LINEARIZABLE, config));
+    local_kv.emplace_back(std::make_unique<LocalKVService>(node, "seq-kv", LocalKVService::SEQUENTIAL, config));
+    local_kv.emplace_back(std::make_unique<LocalKVService>(node, "lww-kv", LocalKVService::LAST_WRITE_WINS, config));
+  }
+
   node.run();
 }
@@ -0,0 +1,94 @@
+#include "kv_state_machine.h"
+#include <functional>
+
+
+KVStateMachine::KVStateMachine()
+{
+  for (auto& bucket : buckets)
+    bucket = std::make_shared<Bucket>();
+}
+
+
+auto KVStateMachine::apply(const json& op) -> Result
+{
+  const std::string& type = op["type"].get_ref<const std::string&>();
+  const std::string key = op["key"].dump();
+  if (type == "write") {
+    writable_bucket(key).insert_or_assign(key, op["value"]);
+    return {};
+  }
+  if (type == "cas") {
+    const Bucket& current = *buckets[bucket_of(key)];
+    auto found = current.find(key);
+    if (found == current.end())
+      return { ERR_KEY_DOES_NOT_EXIST, "key does not exist", {} };
+    if (found->second != op["from"])
+      return { ERR_PRECONDITION_FAILED, "expected " + op["from"].dump() + ", had " + found->second.dump(), {} };
+    writable_bucket(key).insert_or_assign(key, op["to"]);
+    return {};
+  }
+  return { ERR_NOT_SUPPORTED, "unsupported op '" + type + "'", {} };
+}
+
+
+auto KVStateMachine::read(const json& key) const -> Result
+{
+  const std::string id = key.dump();
+  const Bucket& bucket = *buckets[bucket_of(id)];
+  auto found = bucket.find(id);
+  if (found == bucket.end())
+    return { ERR_KEY_DOES_NOT_EXIST, "key does not exist", {} };
+  return { std::nullopt, {}, found->second };
+}
+
+
+auto KVStateMachine::view() const -> View
+{
+  View out;
+  for (std::size_t idx = 0; idx < bucket_count; ++idx)
+    out.buckets[idx] = buckets[idx];
+  return out;
+}
+
+
+auto KVStateMachine::restore(std::string_view data) -> bool
+{
+  json parsed = json::parse(data, nullptr, false);
+  if (parsed.is_discarded() || !parsed.is_object())
+    return false;
+  std::array<std::shared_ptr<Bucket>, bucket_count> restored;
+  for (auto& bucket : restored)
+    bucket = std::make_shared<Bucket>();
+  for (auto& [key, value] : parsed.items())
+    restored[bucket_of(key)]->insert_or_assign(key, std::move(value));
+  buckets = std::move(restored);
+  return true;
+}
+
+
+auto KVStateMachine::View::serialize() const -> std::string
+{
+  json out = json::object();
+  for (const auto& bucket : buckets) {
+    for (const auto& [key, value] : *bucket)
+      out[key] = value;
+  }
+  // ascii only, so the text can be cut into chunks anywhere without splitting a utf-8 sequence
+  return out.dump(-1, ' ', true);
+}
+
+
+auto KVStateMachine::bucket_of(const std::string& key) const -> std::size_t
+{
+  return std::hash<std::string>()(key) % bucket_count;
+}
+
+
+auto KVStateMachine::writable_bucket(const std::string& key) -> Bucket&
+{
+  std::shared_ptr<Bucket>& bucket = buckets[bucket_of(key)];
+  // a live view still references this bucket, leave its copy alone
+  if (bucket.use_count() > 1)
+    bucket = std::make_shared<Bucket>(*bucket);
+  return *bucket;
+}
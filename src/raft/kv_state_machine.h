@@ -0,0 +1,55 @@
+#ifndef RAFT_KV_STATE_MACHINE_HEADER
+#define RAFT_KV_STATE_MACHINE_HEADER
+#include "common/message.h"
+#include "ext/nlohmann/json.hpp"
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// the replicated state behind raft's lin-kv: applies committed write/cas ops and serves reads.
+// the store is split into buckets that are copied on write, so a frozen view for a snapshot costs
+// `bucket_count` reference bumps and a write after it copies at most the one bucket it touches.
+class KVStateMachine
+{
+  using json = nlohmann::json;
+  using Bucket = std::unordered_map<std::string, json>;
+public:
+  static constexpr std::size_t bucket_count = 64;
+
+  struct Result {
+    std::optional<ErrorCode>  error;
+    std::string               text;
+    json                      value;
+  };
+
+  // immutable point-in-time view of the store, safe to serialize on another thread
+  class View
+  {
+  public:
+    auto serialize() const -> std::string;
+  private:
+    friend class KVStateMachine;
+    std::array<std::shared_ptr<const Bucket>, bucket_count> buckets;
+  };
+
+  KVStateMachine();
+
+  // `op` is the logged subset of a client body: type, key and value or from/to
+  auto apply(const json& op) -> Result;
+  auto read(const json& key) const -> Result;
+
+  auto view() const -> View;
+  // replaces the whole store with a serialized view, false if `data` is not one
+  auto restore(std::string_view data) -> bool;
+
+private:
+  auto bucket_of(const std::string& key) const -> std::size_t;
+  auto writable_bucket(const std::string& key) -> Bucket&;
+
+  std::array<std::shared_ptr<Bucket>, bucket_count> buckets;
+};
+
+#endif
@@ -0,0 +1,788 @@
+#include "raft.h"
+#include "common/snowflake.h"
+#include <algorithm>
+#include <iostream>
+
+
+Raft::Raft(Node& node, Config config)
+  : node(node)
+  , config(config)
+  , role(FOLLOWER)
+  , current_term(0)
+  , flush_scheduled(false)
+  , flush_heartbeat(false)
+  , log(1, Entry{ 0, json() })
+  , log_start(0)
+  , commit_index(0)
+  , last_applied(0)
+  , term_start_index(0)
+  , snapshotting(false)
+  , round(0)
+  , lease_expiry(clock::time_point::min())
+{
+  using namespace std::placeholders;
+  node.register_handler(READ_REQ,           std::bind(&Raft::handle_read, this, _1));
+  node.register_handler(WRITE_REQ,          std::bind(&Raft::handle_write, this, _1));
+  node.register_handler(CAS_REQ,            std::bind(&Raft::handle_write, this, _1));
+  node.register_handler(REQUEST_VOTE_REQ,   std::bind(&Raft::handle_request_vote, this, _1));
+  node.register_handler(REQUEST_VOTE_RES,   std::bind(&Raft::handle_request_vote_result, this, _1));
+  node.register_handler(APPEND_ENTRIES_REQ, std::bind(&Raft::handle_append_entries, this, _1));
+  node.register_handler(APPEND_ENTRIES_RES, std::bind(&Raft::handle_append_entries_result, this, _1));
+  node.register_handler(INSTALL_SNAPSHOT_REQ, std::bind(&Raft::handle_install_snapshot, this, _1));
+  node.register_handler(INSTALL_SNAPSHOT_RES, std::bind(&Raft::handle_install_snapshot_result, this, _1));
+}
+
+
+Raft::~Raft()
+{
+  if (snapshot_thread.joinable())
+    snapshot_thread.join();
+}
+
+
+auto Raft::handle_read(const Message& msg) -> Message
+{
+  if (!msg.body.contains("key"))
+    return msg.create_error(ERR_MALFORMED_REQUEST, "read without 'key'");
+  ensure_started();
+
+  std::unique_lock lock(mutex);
+  if (role != LEADER) {
+    lock.unlock();
+    return forward(msg);
+  }
+  // everything committed before the read arrived has to be visible, including the no-op of this term
+  const int64_t read_index = std::max(commit_index, term_start_index);
+  if (peers.empty() || (config.lease_reads && node.now() < lease_expiry)) {
+    pending_reads.push_back({ std::make_shared<Message>(msg), read_index, 0 });
+  } else {
+    pending_reads.push_back({ std::make_shared<Message>(msg), read_index, round + 1 });
+    schedule_flush(true);
+  }
+  serve_reads();
+  return Message();
+}
+
+
+auto Raft::handle_write(const Message& msg) -> Message
+{
+  const bool valid = msg.body.contains("key") && (msg.type == WRITE_REQ
+    ? msg.body.contains("value")
+    : msg.body.contains("from") && msg.body.contains("to"));
+  if (!valid)
+    return msg.create_error(ERR_MALFORMED_REQUEST, "write/cas without 'key', 'value' or 'from'/'to'");
+  ensure_started();
+
+  std::unique_lock lock(mutex);
+  if (role != LEADER) {
+    lock.unlock();
+    return forward(msg);
+  }
+
+  json op = { { "type", msg.type == WRITE_REQ ? "write" : "cas" }, { "key", msg.body["key"] } };
+  if (msg.type == WRITE_REQ) {
+    op["value"] = msg.body["value"];
+  } else {
+    op["from"] = msg.body["from"];
+    op["to"] = msg.body["to"];
+  }
+  log.push_back({ current_term, std::move(op) });
+  pending_writes.insert_or_assign(last_index(), PendingWrite{ std::make_shared<Message>(msg), current_term });
+
+  if (peers.empty())
+    advance_commit();
+  else
+    schedule_flush(false);
+  return Message();
+}
+
+
+auto Raft::handle_request_vote(const Message& msg) -> Message
+{
+  ensure_started();
+  const int64_t term = msg.body.value("term", int64_t(0));
+  const int64_t last_log_index = msg.body.value("last_log_index", int64_t(0));
+  const int64_t last_log_term = msg.body.value("last_log_term", int64_t(0));
+
+  std::unique_lock lock(mutex);
+  const clock::time_point now = node.now();
+  bool granted = false;
+  // leader stickiness: while a live leader is known nobody may win an election,
+  // otherwise a lease held by that leader could overlap with a new leader's term
+  const bool leader_alive = role == LEADER
+    ? now < lease_expiry
+    : !leader_id.empty() && now < last_leader_contact + config.election_timeout_min;
+  if (term > current_term && leader_alive) {
+    std::clog << "[🗳️][RFT] ignoring vote request from '" << msg.from << "', leader '" << leader_id << "' is alive\n";
+  } else {
+    if (term > current_term)
+      step_down(term);
+    const bool up_to_date = last_log_term > term_at(last_index())
+      || (last_log_term == term_at(last_index()) && last_log_index >= last_index());
+    if (term == current_term && (voted_for.empty() || voted_for == msg.from) && up_to_date) {
+      granted = true;
+      voted_for = msg.from;
+      reset_election_deadline();
+    }
+  }
+
+  Message response = msg.create_response();
+  response.body["term"] = current_term;
+  response.body["vote_granted"] = granted;
+  return response;
+}
+
+
+auto Raft::handle_request_vote_result(const Message& msg) -> Message
+{
+  const int64_t term = msg.body.value("term", int64_t(0));
+  std::unique_lock lock(mutex);
+  if (term > current_term) {
+    step_down(term);
+    return Message();
+  }
+  if (role != CANDIDATE || term != current_term || !msg.body.value("vote_granted", false))
+    return Message();
+  votes.insert(msg.from);
+  if (votes.size() >= majority())
+    become_leader();
+  return Message();
+}
+
+
+auto Raft::handle_append_entries(const Message& msg) -> Message
+{
+  ensure_started();
+  const int64_t term = msg.body.value("term", int64_t(0));
+  const int64_t prev_log_index = msg.body.value("prev_log_index", int64_t(0));
+  const int64_t prev_log_term = msg.body.value("prev_log_term", int64_t(0));
+  const int64_t leader_commit = msg.body.value("leader_commit", int64_t(0));
+  static const json no_entries = json::array();
+  const json& entries = msg.body.contains("entries") && msg.body["entries"].is_array() ? msg.body["entries"] : no_entries;
+
+  std::unique_lock lock(mutex);
+  Message response = msg.create_response();
+  response.body["n"] = entries.size();
+  response.body["round"] = msg.body.value("round", uint64_t(0));
+  if (term < current_term) {
+    response.body["term"] = current_term;
+    response.body["success"] = false;
+    response.body["conflict_index"] = last_index() + 1;
+    return response;
+  }
+  if (term > current_term || role != FOLLOWER)
+    step_down(term);
+  leader_id = msg.from;
+  last_leader_contact = node.now();
+  reset_election_deadline();
+  response.body["term"] = current_term;
+
+  if (prev_log_index > last_index()) {
+    response.body["success"] = false;
+    response.body["conflict_index"] = last_index() + 1;
+    return response;
+  }
+  if (prev_log_index >= log_start && term_at(prev_log_index) != prev_log_term) {
+    // skip the whole conflicting term in one go instead of walking back one entry per round trip
+    const int64_t conflicting_term = term_at(prev_log_index);
+    int64_t conflict_index = prev_log_index;
+    while (conflict_index - 1 > log_start && term_at(conflict_index - 1) == conflicting_term)
+      --conflict_index;
+    response.body["success"] = false;
+    response.body["conflict_index"] = conflict_index;
+    return response;
+  }
+
+  int64_t index = prev_log_index;
+  for (const json& entry : entries) {
+    ++index;
+    if (index <= log_start)
+      continue;
+    const int64_t entry_term = entry[0].get<int64_t>();
+    if (index <= last_index()) {
+      if (term_at(index) == entry_term)
+        continue;
+      log.resize(index - log_start);
+    }
+    log.push_back({ entry_term, entry[1] });
+  }
+  // a stale or heartbeat append may end below what is already committed, which never goes back
+  if (leader_commit > commit_index) {
+    commit_index = std::max(commit_index, std::min(leader_commit, index));
+    apply_committed();
+  }
+  response.body["success"] = true;
+  response.body["match_index"] = index;
+  return response;
+}
+
+
+auto Raft::handle_append_entries_result(const Message& msg) -> Message
+{
+  const int64_t term = msg.body.value("term", int64_t(0));
+  std::unique_lock lock(mutex);
+  if (term > current_term) {
+    step_down(term);
+    return Message();
+  }
+  if (role != LEADER || term != current_term)
+    return Message();
+  auto found = peers.find(msg.from);
+  if (found == peers.end())
+    return Message();
+  Peer& peer = found->second;
+
+  if (msg.body.value("n", 0) > 0 && peer.in_flight > 0)
+    --peer.in_flight;
+  // even a rejected append proves the follower still accepts this term, which is all reads need
+  peer.acked_round = std::max(peer.acked_round, msg.body.value("round", uint64_t(0)));
+
+  if (msg.body.value("success", false)) {
+    peer.match_index = std::max(peer.match_index, msg.body.value("match_index", int64_t(0)));
+    peer.next_index = std::max(peer.next_index, peer.match_index + 1);
+    advance_commit();
+  } else {
+    // everything pipelined past the conflict is void, restart from the follower's hint
+    peer.next_index = std::max(peer.match_index + 1, std::min(peer.next_index, msg.body.value("conflict_index", peer.next_index)));
+    peer.in_flight = 0;
+  }
+
+  if (config.lease_reads) {
+    const uint64_t confirmed = quorum_round();
+    if (confirmed > 0 && round - confirmed < round_started.size()) {
+      const auto margin = config.election_timeout_min / 10;
+      lease_expiry = std::max(lease_expiry, round_started[confirmed % round_started.size()] + config.election_timeout_min - margin);
+    }
+  }
+  serve_reads();
+
+  while (!peer.installing && peer.in_flight < config.max_in_flight && peer.next_index <= last_index())
+    send_append(msg.from, peer, false);
+  return Message();
+}
+
+
+auto Raft::handle_install_snapshot(const Message& msg) -> Message
+{
+  ensure_started();
+  const int64_t term = msg.body.value("term", int64_t(0));
+  const int64_t index = msg.body.value("last_included_index", int64_t(0));
+  const int64_t included_term = msg.body.value("last_included_term", int64_t(0));
+  const std::size_t offset = msg.body.value("offset", std::size_t(0));
+  const bool done = msg.body.value("done", false);
+  if (!msg.body.contains("data") || !msg.body["data"].is_string())
+    return msg.create_error(ERR_MALFORMED_REQUEST, "install_snapshot without 'data'");
+
+  std::unique_lock lock(mutex);
+  Message response = msg.create_response();
+  response.body["round"] = msg.body.value("round", uint64_t(0));
+  response.body["last_included_index"] = index;
+  if (term < current_term) {
+    response.body["term"] = current_term;
+    response.body["success"] = false;
+    return response;
+  }
+  if (term > current_term || role != FOLLOWER)
+    step_down(term);
+  leader_id = msg.from;
+  last_leader_contact = node.now();
+  reset_election_deadline();
+  response.body["term"] = current_term;
+  response.body["success"] = true;
+
+  // everything the snapshot covers is already applied here
+  if (index <= last_applied) {
+    response.body["done"] = true;
+    response.body["match_index"] = index;
+    return response;
+  }
+  if (incoming_snapshot.index != index || incoming_snapshot.term != included_term) {
+    incoming_snapshot = { index, included_term, nullptr };
+    incoming_data.clear();
+  }
+  // chunks only ever extend the buffer in order, anything else is answered with the offset expected next
+  const bool in_order = offset == incoming_data.size();
+  if (in_order)
+    incoming_data += msg.body["data"].get_ref<const std::string&>();
+  if (!in_order || !done) {
+    response.body["done"] = false;
+    response.body["offset"] = incoming_data.size();
+    return response;
+  }
+
+  if (!state_machine.restore(incoming_data)) {
+    std::clog << "[❌][RFT] discarding unreadable snapshot at index " << index << '\n';
+    incoming_snapshot = {};
+    incoming_data.clear();
+    response.body["done"] = false;
+    response.body["offset"] = 0;
+    return response;
+  }
+  // a log that already holds the snapshot's last entry keeps its suffix, anything else is superseded
+  if (term_at(index) == included_term) {
+    log.erase(log.begin(), log.begin() + (index - log_start));
+    log.front().op = json();
+  } else {
+    log.assign(1, Entry{ included_term, json() });
+  }
+  log_start = index;
+  commit_index = std::max(commit_index, index);
+  last_applied = index;
+  snapshot = { index, included_term, std::make_shared<const std::string>(std::move(incoming_data)) };
+  incoming_snapshot = {};
+  incoming_data.clear();
+  ++metrics.installed;
+  std::clog << "[📸][RFT] installed snapshot from '" << msg.from << "' at index " << index
+            << " (" << snapshot.data->size() << " bytes)\n";
+  apply_committed();
+
+  response.body["done"] = true;
+  response.body["match_index"] = index;
+  return response;
+}
+
+
+auto Raft::handle_install_snapshot_result(const Message& msg) -> Message
+{
+  const int64_t term = msg.body.value("term", int64_t(0));
+  std::unique_lock lock(mutex);
+  if (term > current_term) {
+    step_down(term);
+    return Message();
+  }
+  if (role != LEADER || term != current_term)
+    return Message();
+  auto found = peers.find(msg.from);
+  if (found == peers.end())
+    return Message();
+  Peer& peer = found->second;
+  peer.acked_round = std::max(peer.acked_round, msg.body.value("round", uint64_t(0)));
+  if (!peer.installing || msg.body.value("last_included_index", int64_t(0)) != peer.snapshot.index)
+    return Message();
+
+  if (!msg.body.value("done", false)) {
+    const std::size_t offset = msg.body.value("offset", std::size_t(0));
+    // a stale ack for a chunk that was resent in the meantime
+    if (offset == peer.snapshot_offset)
+      return Message();
+    peer.snapshot_offset = offset;
+    send_snapshot_chunk(msg.from, peer);
+    return Message();
+  }
+
+  peer.installing = false;
+  peer.match_index = std::max(peer.match_index, msg.body.value("match_index", int64_t(0)));
+  peer.next_index = peer.match_index + 1;
+  peer.in_flight = 0;
+  peer.snapshot = {};
+  peer.snapshot_offset = 0;
+  advance_commit();
+  while (!peer.installing && peer.in_flight < config.max_in_flight && peer.next_index <= last_index())
+    send_append(msg.from, peer, false);
+  return Message();
+}
+
+
+void Raft::ensure_started()
+{
+  std::call_once(started, [this] {
+    {
+      std::unique_lock lock(mutex);
+      reset_election_deadline();
+    }
+    std::clog << "[🚣][RFT] raft started on '" << node.node_id() << "'\n";
+    node.schedule(config.tick_interval, [this] { tick(); });
+  });
+}
+
+
+void Raft::tick()
+{
+  {
+    std::unique_lock lock(mutex);
+    const clock::time_point now = node.now();
+    if (role == LEADER) {
+      if (now >= next_heartbeat)
+        broadcast_append();
+    } else if (now >= election_deadline) {
+      start_election();
+    }
+  }
+  node.schedule(config.tick_interval, [this] { tick(); });
+}
+
+
+auto Raft::forward(const Message& msg) -> Message
+{
+  std::string leader;
+  {
+    std::unique_lock lock(mutex);
+    leader = leader_id;
+  }
+  // a forwarded request is never forwarded again, leadership is in flux and the client may as well retry
+  if (leader.empty() || leader == node.node_id() || msg.body.contains("forwarded"))
+    return msg.create_error(ERR_TEMPORARILY_UNAVAILABLE, "not the leader and no leader known");
+
+  Message forwarded(msg.type, Snowflake::generate_64(), node.node_id(), leader);
+  for (const auto& [field, value] : msg.body.items()) {
+    if (field != "type" && field != "msg_id")
+      forwarded.body[field] = value;
+  }
+  forwarded.body["forwarded"] = true;
+  auto original = std::make_shared<Message>(msg);
+  node.rpc(forwarded, [this, original](const Message& reply) { relay(*original, reply); }, config.forward_timeout);
+  return Message();
+}
+
+
+void Raft::relay(const Message& original, const Message& reply)
+{
+  Message relayed(reply.type, Snowflake::generate_64(), original.id, original.to, original.from);
+  for (const auto& [field, value] : reply.body.items()) {
+    if (field != "type" && field != "msg_id" && field != "in_reply_to")
+      relayed.body[field] = value;
+  }
+  node.send(relayed);
+}
+
+
+auto Raft::last_index() const -> int64_t
+{
+  return log_start + static_cast<int64_t>(log.size()) - 1;
+}
+
+
+auto Raft::term_at(int64_t index) const -> int64_t
+{
+  if (index < log_start || index > last_index())
+    return -1;
+  return log[index - log_start].term;
+}
+
+
+auto Raft::entry_at(int64_t index) -> Entry&
+{
+  return log[index - log_start];
+}
+
+
+auto Raft::majority() const -> std::size_t
+{
+  return node.node_ids().size() / 2 + 1;
+}
+
+
+void Raft::reset_election_deadline()
+{
+  const int64_t spread = config.election_timeout_max.count() - config.election_timeout_min.count() + 1;
+  const int64_t timeout = config.election_timeout_min.count() + static_cast<int64_t>(node.random() % spread);
+  election_deadline = node.now() + std::chrono::milliseconds(timeout);
+}
+
+
+void Raft::step_down(int64_t term)
+{
+  if (term > current_term) {
+    current_term = term;
+    voted_for.clear();
+    leader_id.clear();
+  }
+  if (role == LEADER) {
+    std::clog << "[🪦][RFT] stepping down in term " << current_term << '\n';
+    fail_pending();
+    peers.clear();
+    lease_expiry = clock::time_point::min();
+  }
+  role = FOLLOWER;
+  reset_election_deadline();
+}
+
+
+void Raft::start_election()
+{
+  ++current_term;
+  role = CANDIDATE;
+  voted_for = node.node_id();
+  leader_id.clear();
+  votes = { voted_for };
+  reset_election_deadline();
+  std::clog << "[🗳️][RFT] starting election for term " << current_term << '\n';
+  if (votes.size() >= majority()) {
+    become_leader();
+    return;
+  }
+
+  for (const std::string& id : node.node_ids()) {
+    if (id == node.node_id())
+      continue;
+    Message request(REQUEST_VOTE_REQ, Snowflake::generate_64(), node.node_id(), id);
+    request.body["term"] = current_term;
+    request.body["last_log_index"] = last_index();
+    request.body["last_log_term"] = term_at(last_index());
+    node.send(request);
+  }
+}
+
+
+void Raft::become_leader()
+{
+  std::clog << "[👑][RFT] leader for term " << current_term << '\n';
+  role = LEADER;
+  leader_id = node.node_id();
+  peers.clear();
+  for (const std::string& id : node.node_ids()) {
+    if (id != node.node_id())
+      peers.emplace(id, Peer{ last_index() + 1, 0, 0, 0 });
+  }
+  // reads may only be served once an entry of the new term is committed
+  log.push_back({ current_term, json() });
+  term_start_index = last_index();
+  lease_expiry = clock::time_point::min();
+
+  if (peers.empty())
+    advance_commit();
+  else
+    broadcast_append();
+}
+
+
+void Raft::schedule_flush(bool heartbeat)
+{
+  flush_heartbeat = flush_heartbeat || heartbeat;
+  if (flush_scheduled)
+    return;
+  flush_scheduled = true;
+  // everything appended until the task runs goes out in the same batches
+  node.schedule(config.batch_delay, [this] {
+    std::unique_lock lock(mutex);
+    flush_scheduled = false;
+    const bool heartbeat = flush_heartbeat;
+    flush_heartbeat = false;
+    if (role != LEADER)
+      return;
+    if (heartbeat) {
+      broadcast_append();
+      return;
+    }
+    for (auto& [id, peer] : peers) {
+      while (!peer.installing && peer.in_flight < config.max_in_flight && peer.next_index <= last_index())
+        send_append(id, peer, false);
+    }
+  });
+}
+
+
+void Raft::broadcast_append()
+{
+  const clock::time_point now = node.now();
+  ++round;
+  round_started[round % round_started.size()] = now;
+  next_heartbeat = now + config.heartbeat_interval;
+  for (auto& [id, peer] : peers)
+    send_append(id, peer, true);
+}
+
+
+void Raft::send_append(const std::string& peer_id, Peer& peer, bool heartbeat)
+{
+  // a peer behind the compacted log can only catch up through the snapshot,
+  // heartbeats during the transfer resend the outstanding chunk in case it was lost
+  if (peer.installing) {
+    if (heartbeat)
+      send_snapshot_chunk(peer_id, peer);
+    return;
+  }
+  if (peer.next_index - 1 < log_start) {
+    send_snapshot_chunk(peer_id, peer);
+    return;
+  }
+
+  const bool can_ship = peer.in_flight < config.max_in_flight && peer.next_index <= last_index();
+  if (!heartbeat && !can_ship)
+    return;
+
+  // a heartbeat that cannot carry entries anchors at the last index known to match,
+  // anchoring at the optimistic next_index would fail while earlier batches are still in flight
+  const int64_t prev = can_ship ? peer.next_index - 1 : std::max(peer.match_index, log_start);
+  const int64_t last = can_ship ? std::min<int64_t>(last_index(), prev + config.max_batch) : prev;
+
+  Message request(APPEND_ENTRIES_REQ, Snowflake::generate_64(), node.node_id(), peer_id);
+  json entries = json::array();
+  for (int64_t index = prev + 1; index <= last; ++index) {
+    const Entry& entry = entry_at(index);
+    entries.push_back(json::array({ entry.term, entry.op }));
+  }
+  request.body["term"] = current_term;
+  request.body["prev_log_index"] = prev;
+  request.body["prev_log_term"] = term_at(prev);
+  request.body["entries"] = std::move(entries);
+  request.body["leader_commit"] = commit_index;
+  request.body["round"] = round;
+
+  if (last > prev) {
+    peer.next_index = last + 1;
+    ++peer.in_flight;
+  }
+  node.send(request);
+}
+
+
+void Raft::advance_commit()
+{
+  std::vector<int64_t> matches;
+  matches.reserve(peers.size() + 1);
+  matches.push_back(last_index());
+  for (const auto& [_, peer] : peers)
+    matches.push_back(peer.match_index);
+  std::nth_element(matches.begin(), matches.begin() + (majority() - 1), matches.end(), std::greater<int64_t>());
+  const int64_t replicated = matches[majority() - 1];
+  // only entries of the current term are committed by counting replicas
+  if (replicated > commit_index && term_at(replicated) == current_term) {
+    commit_index = replicated;
+    apply_committed();
+  }
+}
+
+
+void Raft::apply_committed()
+{
+  while (last_applied < commit_index) {
+    ++last_applied;
+    const Entry& entry = entry_at(last_applied);
+    if (entry.op.is_null())
+      continue;
+    KVStateMachine::Result result = state_machine.apply(entry.op);
+
+    auto pending = pending_writes.find(last_applied);
+    if (pending == pending_writes.end())
+      continue;
+    const Message& request = *pending->second.request;
+    if (pending->second.term != entry.term)
+      node.send(request.create_error(ERR_TEMPORARILY_UNAVAILABLE, "entry was overwritten by another leader"));
+    else if (result.error.has_value())
+      node.send(request.create_error(result.error.value(), result.text));
+    else
+      node.send(request.create_response());
+    pending_writes.erase(pending);
+  }
+  serve_reads();
+  maybe_snapshot();
+}
+
+
+void Raft::maybe_snapshot()
+{
+  if (snapshotting || last_applied - log_start < config.snapshot_threshold)
+    return;
+  snapshotting = true;
+  if (snapshot_thread.joinable())
+    snapshot_thread.join();
+
+  // the view pins the current buckets, writes applied from here on copy the buckets they touch instead
+  const int64_t index = last_applied;
+  const int64_t term = term_at(index);
+  snapshot_thread = std::thread([this, index, term, view = state_machine.view()] {
+    const clock::time_point begin = clock::now();
+    auto data = std::make_shared<const std::string>(view.serialize());
+    const uint64_t took = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - begin).count();
+
+    ++metrics.taken;
+    metrics.last_duration_us = took;
+    metrics.max_duration_us = std::max(metrics.max_duration_us.load(), took);
+    metrics.last_size_bytes = data->size();
+    std::clog << "[📸][RFT] snapshot at index " << index << " (" << data->size() << " bytes) in " << took << "us\n";
+
+    std::unique_lock lock(mutex);
+    snapshotting = false;
+    // a snapshot installed from the leader in the meantime may already cover more
+    if (index <= snapshot.index)
+      return;
+    snapshot = { index, term, std::move(data) };
+    compact_log(index, term);
+  });
+}
+
+
+void Raft::compact_log(int64_t index, int64_t term)
+{
+  if (index <= log_start || index > last_index() || term_at(index) != term)
+    return;
+  log.erase(log.begin(), log.begin() + (index - log_start));
+  log.front().op = json();
+  log_start = index;
+}
+
+
+void Raft::send_snapshot_chunk(const std::string& peer_id, Peer& peer)
+{
+  if (!peer.installing) {
+    if (snapshot.data == nullptr)
+      return;
+    peer.installing = true;
+    peer.snapshot = snapshot;
+    peer.snapshot_offset = 0;
+    peer.in_flight = 0;
+    std::clog << "[📸][RFT] sending snapshot at index " << snapshot.index << " to '" << peer_id << "'\n";
+  }
+  const std::string& data = *peer.snapshot.data;
+  const std::size_t offset = std::min(peer.snapshot_offset, data.size());
+  const std::size_t length = std::min(config.snapshot_chunk_size, data.size() - offset);
+
+  Message request(INSTALL_SNAPSHOT_REQ, Snowflake::generate_64(), node.node_id(), peer_id);
+  request.body["term"] = current_term;
+  request.body["last_included_index"] = peer.snapshot.index;
+  request.body["last_included_term"] = peer.snapshot.term;
+  request.body["offset"] = offset;
+  request.body["data"] = data.substr(offset, length);
+  request.body["done"] = offset + length == data.size();
+  request.body["round"] = round;
+  ++metrics.chunks_sent;
+  node.send(request);
+}
+
+
+auto Raft::quorum_round() const -> uint64_t
+{
+  std::vector<uint64_t> acked;
+  acked.reserve(peers.size() + 1);
+  acked.push_back(round);
+  for (const auto& [_, peer] : peers)
+    acked.push_back(peer.acked_round);
+  std::nth_element(acked.begin(), acked.begin() + (majority() - 1), acked.end(), std::greater<uint64_t>());
+  return acked[majority() - 1];
+}
+
+
+void Raft::serve_reads()
+{
+  if (pending_reads.empty())
+    return;
+  const uint64_t confirmed = quorum_round();
+  auto unserved = std::remove_if(pending_reads.begin(), pending_reads.end(), [&](const PendingRead& read) {
+    if ((read.round != 0 && confirmed < read.round) || last_applied < read.read_index)
+      return false;
+    KVStateMachine::Result result = state_machine.read(read.request->body["key"]);
+    if (result.error.has_value()) {
+      node.send(read.request->create_error(result.error.value(), result.text));
+    } else {
+      Message response = read.request->create_response();
+      response.body["value"] = std::move(result.value);
+      node.send(response);
+    }
+    return true;
+  });
+  pending_reads.erase(unserved, pending_reads.end());
+}
+
+
+void Raft::fail_pending()
+{
+  // an outstanding write may still be committed by the next leader, so its outcome is unknown.
+  // reads never had an effect and can be refused outright
+  for (auto& [_, pending] : pending_writes)
+    node.send(pending.request->create_error(ERR_TIMEOUT, "leadership lost, outcome unknown"));
+  pending_writes.clear();
+  for (PendingRead& read : pending_reads)
+    node.send(read.request->create_error(ERR_TEMPORARILY_UNAVAILABLE, "leadership lost"));
+  pending_reads.clear();
+}
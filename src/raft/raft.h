@@ -0,0 +1,181 @@
+#ifndef RAFT_RAFT_HEADER
+#define RAFT_RAFT_HEADER
+#include "kv_state_machine.h"
+#include "common/message.h"
+#include "common/node.h"
+#include "ext/nlohmann/json.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// raft replicated lin-kv, serving maelstrom's read/write/cas against the node itself.
+// writes and cas go through the log, appends to followers are pipelined (up to `max_in_flight`
+// unacknowledged batches per peer) and batched (everything appended while a flush is queued goes out together).
+// reads skip the log: the leader serves them under a quorum-confirmed lease, or when leases are off
+// after a heartbeat round started past the read's arrival has been acknowledged by a quorum (read-index).
+// followers proxy client requests to the leader they know of.
+// once `snapshot_threshold` entries are applied past the last snapshot, a copy-on-write view of the state
+// is serialized on a background thread and the log is truncated up to it. followers that fall behind the
+// truncated log receive the snapshot in `snapshot_chunk_size` pieces, one chunk in flight at a time.
+// the whole protocol stays idle until the first raft message arrives so other workloads are not charged for heartbeats.
+class Raft
+{
+  using json  = nlohmann::json;
+  using clock = std::chrono::steady_clock;
+public:
+  struct Config {
+    std::chrono::milliseconds election_timeout_min  = std::chrono::milliseconds(150);
+    std::chrono::milliseconds election_timeout_max  = std::chrono::milliseconds(300);
+    std::chrono::milliseconds heartbeat_interval    = std::chrono::milliseconds(30);
+    std::chrono::milliseconds tick_interval         = std::chrono::milliseconds(5);
+    std::chrono::microseconds batch_delay           = std::chrono::microseconds(200);
+    std::chrono::milliseconds forward_timeout       = std::chrono::milliseconds(1000);
+    std::size_t               max_batch             = 256;
+    int                       max_in_flight         = 8;
+    bool                      lease_reads           = true;
+    int64_t                   snapshot_threshold    = 8192;
+    std::size_t               snapshot_chunk_size   = 64 * 1024;
+  };
+
+  struct SnapshotMetrics {
+    std::atomic<uint64_t> taken             = 0;
+    std::atomic<uint64_t> installed         = 0;
+    std::atomic<uint64_t> chunks_sent       = 0;
+    std::atomic<uint64_t> last_duration_us  = 0;
+    std::atomic<uint64_t> max_duration_us   = 0;
+    std::atomic<uint64_t> last_size_bytes   = 0;
+  };
+
+  Raft(Node& node, Config config);
+  explicit Raft(Node& node) : Raft(node, Config()) {}
+  ~Raft();
+
+  auto snapshot_metrics() const -> const SnapshotMetrics& { return metrics; }
+
+private:
+  auto handle_read(const Message& msg) -> Message;
+  auto handle_write(const Message& msg) -> Message;
+  auto handle_request_vote(const Message& msg) -> Message;
+  auto handle_request_vote_result(const Message& msg) -> Message;
+  auto handle_append_entries(const Message& msg) -> Message;
+  auto handle_append_entries_result(const Message& msg) -> Message;
+  auto handle_install_snapshot(const Message& msg) -> Message;
+  auto handle_install_snapshot_result(const Message& msg) -> Message;
+
+  void ensure_started();
+  void tick();
+  // proxies a client request to the current leader, or refuses it when there is none
+  auto forward(const Message& msg) -> Message;
+  void relay(const Message& original, const Message& reply);
+
+private:
+  // everything below is guarded by `mutex`
+  enum Role {
+    FOLLOWER,
+    CANDIDATE,
+    LEADER,
+  };
+  struct Entry {
+    int64_t term;
+    json    op;
+  };
+  struct Snapshot {
+    int64_t                             index = 0;
+    int64_t                             term  = 0;
+    std::shared_ptr<const std::string>  data;
+  };
+  struct Peer {
+    int64_t     next_index;
+    int64_t     match_index;
+    int         in_flight;
+    uint64_t    acked_round;
+    // install_snapshot progress, the peer keeps the snapshot it started with even if a newer one is taken
+    bool        installing      = false;
+    Snapshot    snapshot;
+    std::size_t snapshot_offset = 0;
+  };
+  struct PendingWrite {
+    std::shared_ptr<Message>  request;
+    int64_t                   term;
+  };
+  struct PendingRead {
+    std::shared_ptr<Message>  request;
+    int64_t                   read_index;
+    uint64_t                  round;
+  };
+
+  auto last_index() const -> int64_t;
+  auto term_at(int64_t index) const -> int64_t;
+  auto entry_at(int64_t index) -> Entry&;
+  auto majority() const -> std::size_t;
+
+  void reset_election_deadline();
+  void step_down(int64_t term);
+  void start_election();
+  void become_leader();
+
+  void schedule_flush(bool heartbeat);
+  void broadcast_append();
+  void send_append(const std::string& peer_id, Peer& peer, bool heartbeat);
+  void advance_commit();
+  void apply_committed();
+
+  void maybe_snapshot();
+  void compact_log(int64_t index, int64_t term);
+  void send_snapshot_chunk(const std::string& peer_id, Peer& peer);
+
+  auto quorum_round() const -> uint64_t;
+  void serve_reads();
+  void fail_pending();
+
+private:
+  Node&                                   node;
+  const Config                            config;
+  std::once_flag                          started;
+
+  std::mutex                              mutex;
+  Role                                    role;
+  int64_t                                 current_term;
+  std::string                             voted_for;
+  std::string                             leader_id;
+  std::unordered_set<std::string>         votes;
+  clock::time_point                       election_deadline;
+  clock::time_point                       last_leader_contact;
+  clock::time_point                       next_heartbeat;
+  bool                                    flush_scheduled;
+  bool                                    flush_heartbeat;
+
+  // log[0] is a sentinel for index `log_start`, the last index covered by the snapshot
+  std::deque<Entry>                       log;
+  int64_t                                 log_start;
+  int64_t                                 commit_index;
+  int64_t                                 last_applied;
+  int64_t                                 term_start_index;
+  KVStateMachine                          state_machine;
+
+  Snapshot                                snapshot;
+  Snapshot                                incoming_snapshot;
+  std::string                             incoming_data;
+  bool                                    snapshotting;
+  std::thread                             snapshot_thread;
+  SnapshotMetrics                         metrics;
+
+  std::unordered_map<std::string, Peer>   peers;
+  uint64_t                                round;
+  std::array<clock::time_point, 64>       round_started;
+  clock::time_point                       lease_expiry;
+
+  std::unordered_map<int64_t, PendingWrite> pending_writes;
+  std::vector<PendingRead>                  pending_reads;
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "simulator.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+  // hands everything a node sends to the simulator's network, nodes never read from it
+  class Wire final : public Transport
+  {
+  public:
+    explicit Wire(std::function<void(const Message&)> route) : route(std::move(route)) {}
+
+    auto read(std::string&) -> bool override { return false; }
+    void send(const Message& msg) override { route(msg); }
+  private:
+    std::function<void(const Message&)> route;
+  };
+}
+
+Simulator::Simulator(Config config, setup_fn setup)
+  : config(config)
+  , engine(config.seed)
+  // far enough from the epoch that nobody's time_point::min() sentinel comes out ahead of it
+  , virtual_now(clock::time_point() + std::chrono::hours(1))
+  , origin(virtual_now)
+  , sequence(0)
+  , next_msg_id(1)
+{
+  for (std::size_t idx = 0; idx < config.nodes; ++idx)
+    ids.push_back(std::string("n").append(std::to_string(idx)));
+
+  for (std::size_t idx = 0; idx < config.nodes; ++idx) {
+    auto node = std::make_unique<Node>(0);
+    node->seed(engine());
+    node->set_clock([this] { return virtual_now; });
+    node->set_transport(std::make_unique<Wire>(std::bind(&Simulator::route, this, std::placeholders::_1)));
+    handlers.push_back(setup(*node));
+    nodes.push_back(std::move(node));
+  }
+  for (std::size_t idx = 0; idx < config.nodes; ++idx) {
+    json init = { { "src", "c0" }, { "dest", ids[idx] },
+      { "body", { { "type", "init" }, { "msg_id", next_msg_id++ }, { "node_id", ids[idx] }, { "node_ids", ids } } } };
+    std::optional<Message> msg = Message::from_json(init);
+    nodes[idx]->deliver(std::move(msg.value()));
+  }
+  settle();
+}
+
+
+Simulator::~Simulator()
+{
+  // handlers reference their node, they go first
+  handlers.clear();
+  nodes.clear();
+}
+
+
+auto Simulator::elapsed() const -> std::chrono::microseconds
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(virtual_now - origin);
+}
+
+
+void Simulator::partition(const std::vector<std::vector<std::string>>& partitions)
+{
+  groups.clear();
+  for (std::size_t group = 0; group < partitions.size(); ++group) {
+    for (const std::string& id : partitions[group])
+      groups[id] = group;
+  }
+}
+
+
+void Simulator::heal()
+{
+  groups.clear();
+}
+
+
+void Simulator::request(std::string_view client, std::string_view node, json body, reply_fn on_reply,
+  std::chrono::microseconds timeout)
+{
+  const uint64_t msg_id = next_msg_id++;
+  const std::string type = body.value("type", "");
+  body["msg_id"] = msg_id;
+  requests.insert_or_assign(msg_id, Request{ type, virtual_now, std::move(on_reply) });
+  std::optional<Message> msg = Message::from_json({ { "src", client }, { "dest", node }, { "body", std::move(body) } });
+  if (!msg.has_value()) {
+    std::clog << "[❌][SIM] cannot build a '" << type << "' request\n";
+    return;
+  }
+  route(msg.value());
+  after(timeout, [this, msg_id] {
+    auto found = requests.find(msg_id);
+    if (found == requests.end())
+      return;
+    Request expired = std::move(found->second);
+    requests.erase(found);
+    ++operations[expired.type].timeouts;
+    expired.on_reply(std::nullopt);
+  });
+}
+
+
+void Simulator::after(std::chrono::microseconds delay, std::function<void()> event)
+{
+  events.push({ virtual_now + delay, sequence++, std::move(event) });
+}
+
+
+void Simulator::run_for(std::chrono::microseconds duration)
+{
+  const clock::time_point end = virtual_now + duration;
+  while (true) {
+    std::optional<clock::time_point> next_timer;
+    for (const std::unique_ptr<Node>& node : nodes) {
+      std::optional<clock::time_point> due = node->next_timer();
+      if (due.has_value() && (!next_timer.has_value() || due.value() < next_timer.value()))
+        next_timer = due;
+    }
+    const bool has_event = !events.empty();
+    if (!has_event && !next_timer.has_value())
+      break;
+    // timers win ties, a message arriving at the same instant sees their effects
+    const bool timer_first = next_timer.has_value() && (!has_event || next_timer.value() <= events.top().due);
+    const clock::time_point due = timer_first ? next_timer.value() : events.top().due;
+    if (due > end)
+      break;
+    virtual_now = std::max(virtual_now, due);
+    if (timer_first) {
+      for (const std::unique_ptr<Node>& node : nodes)
+        node->fire_timers();
+    } else {
+      std::function<void()> fire = std::move(const_cast<Event&>(events.top()).fire);
+      events.pop();
+      fire();
+    }
+    settle();
+  }
+  virtual_now = end;
+}
+
+
+void Simulator::settle()
+{
+  bool ran = true;
+  while (ran) {
+    ran = false;
+    for (const std::unique_ptr<Node>& node : nodes)
+      ran |= node->run_pending() > 0;
+  }
+}
+
+
+void Simulator::route(const Message& msg)
+{
+  Traffic& counts = traffic[std::string(message_type_to_string(msg.type))];
+  ++counts.sent;
+  const std::optional<std::size_t> dest = index_of(msg.to);
+  const bool dropped = (dest.has_value() && !reachable(msg.from, msg.to))
+    || std::uniform_real_distribution<double>(0.0, 1.0)(engine) < config.drop_rate;
+  if (dropped) {
+    ++counts.dropped;
+    return;
+  }
+  auto copy = std::make_shared<Message>(msg);
+  after(latency(), [this, dest, copy] {
+    ++traffic[std::string(message_type_to_string(copy->type))].delivered;
+    if (!dest.has_value()) {
+      reply(*copy);
+      return;
+    }
+    nodes[dest.value()]->deliver(Message(*copy));
+  });
+}
+
+
+void Simulator::reply(const Message& msg)
+{
+  if (!msg.body.contains("in_reply_to") || !msg.body["in_reply_to"].is_number_unsigned())
+    return;
+  auto found = requests.find(msg.body["in_reply_to"].get<uint64_t>());
+  if (found == requests.end())
+    return;
+  Request answered = std::move(found->second);
+  requests.erase(found);
+  Operation& operation = operations[answered.type];
+  if (msg.type == ERROR_RES)
+    ++operation.errors;
+  else
+    ++operation.ok;
+  operation.latencies_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(virtual_now - answered.sent).count());
+  answered.on_reply(msg);
+}
+
+
+auto Simulator::latency() -> std::chrono::microseconds
+{
+  const int64_t min = config.latency_min.count();
+  const int64_t mean = std::max(config.latency_mean.count(), min);
+  switch (config.distribution) {
+    case FIXED:
+      return std::chrono::microseconds(mean);
+    case UNIFORM:
+      return std::chrono::microseconds(std::uniform_int_distribution<int64_t>(min, 2 * mean - min)(engine));
+    case EXPONENTIAL:
+      if (mean == min)
+        return std::chrono::microseconds(min);
+      return std::chrono::microseconds(min + static_cast<int64_t>(std::exponential_distribution<double>(1.0 / (mean - min))(engine)));
+  }
+  return std::chrono::microseconds(mean);
+}
+
+
+auto Simulator::reachable(const std::string& from, const std::string& to) const -> bool
+{
+  if (groups.empty())
+    return true;
+  auto lhs = groups.find(from), rhs = groups.find(to);
+  // nodes left out of every group are cut off from everyone
+  return lhs != groups.end() && rhs != groups.end() && lhs->second == rhs->second;
+}
+
+
+auto Simulator::index_of(std::string_view id) const -> std::optional<std::size_t>
+{
+  auto found = std::find(ids.begin(), ids.end(), id);
+  if (found == ids.end())
+    return std::nullopt;
+  return found - ids.begin();
+}
+
+
+void Simulator::report(std::ostream& out) const
+{
+  char line[160];
+  const double seconds = elapsed().count() / 1e6;
+  std::snprintf(line, sizeof(line), "%-26s %12s %12s %12s\n", "message", "sent", "delivered", "dropped");
+  out << line;
+  for (const auto& [type, counts] : traffic) {
+    std::snprintf(line, sizeof(line), "%-26s %12lu %12lu %12lu\n", type.c_str(),
+      static_cast<unsigned long>(counts.sent), static_cast<unsigned long>(counts.delivered), static_cast<unsigned long>(counts.dropped));
+    out << line;
+  }
+  std::snprintf(line, sizeof(line), "\n%-14s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+    "request", "ok", "errors", "timeouts", "ok/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+  out << line;
+  for (const auto& [type, operation] : operations) {
+    std::vector<uint64_t> sorted = operation.latencies_us;
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&](double quantile) {
+      return sorted.empty() ? 0.0 : sorted[std::min<std::size_t>(sorted.size() - 1, quantile * sorted.size())] / 1e3;
+    };
+    std::snprintf(line, sizeof(line), "%-14s %10lu %10lu %10lu %10.1f %10.2f %10.2f %10.2f %10.2f\n", type.c_str(),
+      static_cast<unsigned long>(operation.ok), static_cast<unsigned long>(operation.errors),
+      static_cast<unsigned long>(operation.timeouts), seconds > 0 ? operation.ok / seconds : 0.0,
+      percentile(0.5), percentile(0.99), percentile(0.999), sorted.empty() ? 0.0 : sorted.back() / 1e3);
+    out << line;
+  }
+}
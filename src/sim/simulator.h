@@ -0,0 +1,129 @@
+#ifndef SIM_SIMULATOR_HEADER
+#define SIM_SIMULATOR_HEADER
+#include "common/message.h"
+#include "common/node.h"
+#include "ext/nlohmann/json.hpp"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// deterministic multi-node simulation in one process and on one thread.
+// every node is built without workers and runs on a virtual clock: the simulator delivers messages and fires
+// timers in virtual-time order, running each node's queued tasks to completion in between. messages between
+// nodes and to clients get a latency drawn from the configured distribution, may be dropped at random and are
+// dropped across partitions. all randomness, the nodes' included, comes from the seed, so a run with the same
+// seed, setup and workload replays the exact same schedule.
+class Simulator
+{
+  using json = nlohmann::json;
+public:
+  using clock = std::chrono::steady_clock;
+
+  enum Distribution {
+    FIXED,
+    UNIFORM,
+    EXPONENTIAL,
+  };
+
+  struct Config {
+    std::size_t               nodes         = 3;
+    uint64_t                  seed          = 1;
+    Distribution              distribution  = EXPONENTIAL;
+    // FIXED: always `latency_mean`. UNIFORM: between min and 2 * mean - min. EXPONENTIAL: min plus an exponential tail
+    std::chrono::microseconds latency_min   = std::chrono::microseconds(100);
+    std::chrono::microseconds latency_mean  = std::chrono::microseconds(1000);
+    double                    drop_rate     = 0.0;
+  };
+
+  // builds the handlers a node runs, the returned object lives as long as the node
+  using setup_fn = std::function<std::shared_ptr<void>(Node&)>;
+  Simulator(Config config, setup_fn setup);
+  ~Simulator();
+  Simulator(const Simulator&) = delete;
+  auto operator=(const Simulator&) -> Simulator& = delete;
+
+  auto now() const -> clock::time_point { return virtual_now; }
+  auto elapsed() const -> std::chrono::microseconds;
+  auto node_ids() const -> const std::vector<std::string>& { return ids; }
+  auto random() -> uint64_t { return engine(); }
+
+  // messages between nodes of different groups are dropped until `heal`
+  void partition(const std::vector<std::vector<std::string>>& groups);
+  void heal();
+
+  // sends `body` from `client` to `node`. `on_reply` gets the reply, or nullopt once `timeout` passed without one
+  using reply_fn = std::function<void(const std::optional<Message>&)>;
+  void request(std::string_view client, std::string_view node, json body, reply_fn on_reply,
+    std::chrono::microseconds timeout = std::chrono::seconds(1));
+  // runs `event` once `delay` of virtual time has passed
+  void after(std::chrono::microseconds delay, std::function<void()> event);
+
+  void run_for(std::chrono::microseconds duration);
+
+  // message counts per type, client round trips per request type
+  void report(std::ostream& out) const;
+
+private:
+  struct Event {
+    clock::time_point     due;
+    uint64_t              sequence;
+    std::function<void()> fire;
+
+    auto operator>(const Event& other) const -> bool
+    {
+      return due != other.due ? due > other.due : sequence > other.sequence;
+    }
+  };
+  struct Request {
+    std::string             type;
+    clock::time_point       sent;
+    reply_fn                on_reply;
+  };
+  struct Traffic {
+    uint64_t sent       = 0;
+    uint64_t delivered  = 0;
+    uint64_t dropped    = 0;
+  };
+  struct Operation {
+    uint64_t              ok        = 0;
+    uint64_t              errors    = 0;
+    uint64_t              timeouts  = 0;
+    std::vector<uint64_t> latencies_us;
+  };
+
+  void route(const Message& msg);
+  void reply(const Message& msg);
+  auto latency() -> std::chrono::microseconds;
+  auto reachable(const std::string& from, const std::string& to) const -> bool;
+  auto index_of(std::string_view id) const -> std::optional<std::size_t>;
+  // runs every node's queued tasks until all are idle
+  void settle();
+
+  const Config                                  config;
+  std::mt19937_64                               engine;
+  clock::time_point                             virtual_now;
+  const clock::time_point                       origin;
+  uint64_t                                      sequence;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+
+  std::vector<std::string>                      ids;
+  std::vector<std::unique_ptr<Node>>            nodes;
+  std::vector<std::shared_ptr<void>>            handlers;
+  std::unordered_map<std::string, std::size_t>  groups;
+
+  uint64_t                                      next_msg_id;
+  std::unordered_map<uint64_t, Request>         requests;
+  std::map<std::string, Traffic>                traffic;
+  std::map<std::string, Operation>              operations;
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "mvcc_store.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+
+MVCCStore::MVCCStore()
+  : next_ts(0)
+  , visible(0)
+  , watermark(0)
+{
+}
+
+
+auto MVCCStore::begin() -> uint64_t
+{
+  std::unique_lock lock(mutex_snapshots);
+  const uint64_t snapshot = visible.load();
+  snapshots.insert(snapshot);
+  watermark = *snapshots.begin();
+  return snapshot;
+}
+
+
+void MVCCStore::end(uint64_t snapshot)
+{
+  std::unique_lock lock(mutex_snapshots);
+  auto found = snapshots.find(snapshot);
+  if (found != snapshots.end())
+    snapshots.erase(found);
+  // with nobody reading, everything up to the latest commit is the floor for the next snapshot anyway
+  watermark = snapshots.empty() ? visible.load() : *snapshots.begin();
+}
+
+
+auto MVCCStore::read(const std::string& key, uint64_t snapshot) const -> json
+{
+  {
+    const Stripe& stripe = stripes[stripe_of(key)];
+    std::shared_lock lock(stripe.mutex);
+    auto found = stripe.chains.find(key);
+    if (found != stripe.chains.end()) {
+      const std::vector<Version>& chain = found->second;
+      for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        if (it->ts <= snapshot)
+          return it->value;
+      }
+    }
+  }
+  std::optional<Version> based = base_version(key);
+  return based.has_value() ? std::move(based->value) : json();
+}
+
+
+auto MVCCStore::latest() const -> uint64_t
+{
+  return visible.load();
+}
+
+
+auto MVCCStore::commit(uint64_t snapshot, const std::vector<Write>& writes, Isolation isolation) -> std::optional<uint64_t>
+{
+  // stripes are locked in index order so overlapping commits cannot deadlock
+  std::vector<std::size_t> involved;
+  involved.reserve(writes.size());
+  for (const Write& write : writes)
+    involved.push_back(stripe_of(write.key));
+  std::sort(involved.begin(), involved.end());
+  involved.erase(std::unique(involved.begin(), involved.end()), involved.end());
+
+  std::vector<std::unique_lock<std::shared_mutex>> locks;
+  locks.reserve(involved.size());
+  for (std::size_t idx : involved)
+    locks.emplace_back(stripes[idx].mutex);
+
+  if (isolation == SNAPSHOT) {
+    for (const Write& write : writes) {
+      const Stripe& stripe = stripes[stripe_of(write.key)];
+      auto found = stripe.chains.find(write.key);
+      if (found != stripe.chains.end() && !found->second.empty() && found->second.back().ts > snapshot)
+        return std::nullopt;
+    }
+  }
+
+  // allocated under the stripe locks, so every chain stays ordered by timestamp
+  const uint64_t ts = ++next_ts;
+  const uint64_t floor = watermark.load();
+  for (const Write& write : writes) {
+    std::vector<Version>& chain = stripes[stripe_of(write.key)].chains[write.key];
+    if (!chain.empty() && write.stamp <= chain.back().stamp)
+      continue;
+    if (chain.empty()) {
+      if (std::optional<Version> based = base_version(write.key); based.has_value() && write.stamp <= based->stamp)
+        continue;
+    }
+    chain.push_back({ ts, write.stamp, write.value });
+    prune(chain, floor);
+  }
+  return ts;
+}
+
+
+void MVCCStore::publish(uint64_t ts)
+{
+  // a snapshot taken at `visible` must see every commit up to it, so it only advances over a gap-free run
+  std::unique_lock lock(mutex_published);
+  published.insert(ts);
+  uint64_t last = visible.load();
+  while (!published.empty() && *published.begin() == last + 1) {
+    last = *published.begin();
+    published.erase(published.begin());
+  }
+  visible.store(last);
+}
+
+
+auto MVCCStore::low_watermark() const -> uint64_t
+{
+  return watermark.load();
+}
+
+
+void MVCCStore::set_base(std::shared_ptr<const SnapshotFile> snapshot)
+{
+  base = std::move(snapshot);
+}
+
+
+void MVCCStore::dump(SnapshotWriter& writer) const
+{
+  std::vector<std::pair<std::string, std::string>> entries;
+  for (const Stripe& stripe : stripes) {
+    std::shared_lock lock(stripe.mutex);
+    for (const auto& [key, chain] : stripe.chains) {
+      if (!chain.empty())
+        entries.emplace_back(key, encode_version(chain.back()));
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+
+  // merge with the base, keys written since it was taken win
+  auto written = entries.begin();
+  if (nullptr != base) {
+    base->for_each([&](std::string_view key, std::string_view value) {
+      while (written != entries.end() && written->first < key) {
+        writer.add(written->first, written->second);
+        ++written;
+      }
+      if (written != entries.end() && written->first == key)
+        return;
+      writer.add(key, value);
+    });
+  }
+  for (; written != entries.end(); ++written)
+    writer.add(written->first, written->second);
+}
+
+
+auto MVCCStore::base_version(const std::string& key) const -> std::optional<Version>
+{
+  if (nullptr == base)
+    return std::nullopt;
+  std::optional<std::string_view> raw = base->find(key);
+  if (!raw.has_value() || raw->size() < sizeof(uint64_t))
+    return std::nullopt;
+  uint64_t stamp;
+  std::memcpy(&stamp, raw->data(), sizeof(stamp));
+  json value = json::parse(raw->substr(sizeof(uint64_t)), nullptr, false);
+  if (value.is_discarded())
+    return std::nullopt;
+  return Version{ 0, Snowflake::from_json(stamp).value_or(Snowflake()), std::move(value) };
+}
+
+
+auto MVCCStore::encode_version(const Version& version) -> std::string
+{
+  const json stamp = version.stamp.as_json();
+  const uint64_t raw = stamp.is_number() ? stamp.get<uint64_t>() : 0;
+  std::string out(sizeof(raw), '\0');
+  std::memcpy(out.data(), &raw, sizeof(raw));
+  out += version.value.dump();
+  return out;
+}
+
+
+auto MVCCStore::stripe_of(const std::string& key) const -> std::size_t
+{
+  return std::hash<std::string>()(key) % stripe_count;
+}
+
+
+void MVCCStore::prune(std::vector<Version>& chain, uint64_t watermark)
+{
+  // the newest version at or below the watermark is what the oldest snapshot reads, everything before it is dead
+  auto visible_to_oldest = std::find_if(chain.rbegin(), chain.rend(), [watermark](const Version& version) {
+    return version.ts <= watermark;
+  });
+  if (visible_to_oldest == chain.rend())
+    return;
+  chain.erase(chain.begin(), std::prev(visible_to_oldest.base()));
+}
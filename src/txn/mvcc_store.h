@@ -0,0 +1,102 @@
+#ifndef TXN_MVCC_STORE_HEADER
+#define TXN_MVCC_STORE_HEADER
+#include "common/snapshot_file.h"
+#include "common/snowflake.h"
+#include "ext/nlohmann/json.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// multi-version register store behind txn-rw-register.
+// every key holds a chain of committed versions ordered by commit timestamp. transactions read at a snapshot
+// timestamp and only ever hold a stripe's shared lock for one chain lookup, commits install one version per
+// written key atomically. an installed commit already takes part in first-committer-wins, but snapshots only see
+// it once it is published, and commits become visible strictly in timestamp order.
+// a chain is pruned whenever it is written, down to the newest version the oldest registered snapshot
+// (the low watermark) can still observe.
+// every write carries a last-writer-wins stamp and only becomes a key's newest version if it beats the stamp
+// already there, so replicas that see the same writes in any order converge.
+// an optional base snapshot holds the newest value of every key as of a checkpoint. it sits below every
+// chain as timestamp 0 and is read straight out of its mapping for keys nobody wrote since.
+class MVCCStore
+{
+  using json = nlohmann::json;
+public:
+  enum Isolation {
+    READ_COMMITTED,
+    SNAPSHOT,
+  };
+
+  static constexpr std::size_t stripe_count = 64;
+
+  struct Write {
+    std::string key;
+    json        value;
+    Snowflake   stamp;
+  };
+
+  MVCCStore();
+
+  // registers a snapshot at the latest visible commit, versions it can observe survive until `end`
+  auto begin() -> uint64_t;
+  void end(uint64_t snapshot);
+
+  // value of the newest version committed at or before `snapshot`, null if there is none
+  auto read(const std::string& key, uint64_t snapshot) const -> json;
+  auto latest() const -> uint64_t;
+
+  // installs `writes` under a fresh commit timestamp, skipping writes beaten by a newer stamp.
+  // under SNAPSHOT the commit is refused (nullopt) when any written key already has a version newer
+  // than `snapshot`, first committer wins
+  auto commit(uint64_t snapshot, const std::vector<Write>& writes, Isolation isolation) -> std::optional<uint64_t>;
+  // makes the commit at `ts` visible, along with every earlier one already published. never blocks,
+  // a commit published ahead of an earlier one waits in `published` for it
+  void publish(uint64_t ts);
+
+  auto low_watermark() const -> uint64_t;
+
+  // only valid before the store is used
+  void set_base(std::shared_ptr<const SnapshotFile> snapshot);
+  // writes the newest value of every key, base included, as a snapshot a later store can use as its base
+  void dump(SnapshotWriter& writer) const;
+
+private:
+  struct Version {
+    uint64_t  ts;
+    Snowflake stamp;
+    json      value;
+  };
+  struct Stripe {
+    mutable std::shared_mutex                             mutex;
+    std::unordered_map<std::string, std::vector<Version>> chains;
+  };
+
+  auto stripe_of(const std::string& key) const -> std::size_t;
+  // base entries are [u64 stamp][value as json]
+  auto base_version(const std::string& key) const -> std::optional<Version>;
+  static auto encode_version(const Version& version) -> std::string;
+  static void prune(std::vector<Version>& chain, uint64_t watermark);
+
+  std::array<Stripe, stripe_count>  stripes;
+  // last allocated commit timestamp, and the one up to which every commit is fully installed
+  std::atomic<uint64_t>             next_ts;
+  std::atomic<uint64_t>             visible;
+  std::mutex                        mutex_published;
+  std::set<uint64_t>                published;
+
+  std::mutex                        mutex_snapshots;
+  std::multiset<uint64_t>           snapshots;
+  std::atomic<uint64_t>             watermark;
+
+  std::shared_ptr<const SnapshotFile> base;
+};
+
+#endif
@@ -0,0 +1,287 @@
+#include "txn.h"
+#include "common/snowflake.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+  using json = nlohmann::json;
+
+  auto is_micro_op(const json& op) -> bool
+  {
+    if (!op.is_array() || op.size() != 3 || !op[0].is_string())
+      return false;
+    const std::string& type = op[0].get_ref<const std::string&>();
+    return type == "r" || type == "w";
+  }
+}
+
+
+Txn::Txn(Node& node, Config config)
+  : node(node)
+  , config(config)
+  , index(0)
+  , flush_scheduled(false)
+{
+  using namespace std::placeholders;
+  node.register_handler(TXN_REQ,           std::bind(&Txn::handle_txn, this, _1));
+  node.register_handler(TXN_REPLICATE_REQ, std::bind(&Txn::handle_replicate, this, _1));
+  node.register_replay("txn", std::bind(&Txn::replay, this, _1));
+  node.register_checkpoint("txn", std::bind(&MVCCStore::dump, &store, _1), std::bind(&MVCCStore::set_base, &store, _1));
+}
+
+
+auto Txn::handle_txn(const Message& msg) -> Message
+{
+  if (!msg.body.contains("txn") || !msg.body["txn"].is_array())
+    return msg.create_error(ERR_MALFORMED_REQUEST, "txn without 'txn'");
+  for (const json& op : msg.body["txn"]) {
+    if (!is_micro_op(op))
+      return msg.create_error(ERR_MALFORMED_REQUEST, "txn micro-op is not [\"r\"|\"w\", key, value]");
+  }
+
+  auto commit = std::make_shared<Commit>();
+  std::optional<json> completed = execute(msg.body["txn"], commit.get());
+  if (!completed.has_value()) {
+    std::clog << "[💥][TXN] giving up on txn after " << config.max_attempts << " conflicting attempts\n";
+    return msg.create_error(ERR_TXN_CONFLICT, "txn conflicted with concurrent writes");
+  }
+  Message response = msg.create_response();
+  response.body["txn"] = std::move(completed.value());
+  if (commit->writes.empty())
+    return response;
+  // encoding sorts and moves out of the batch, the commit keeps its own for replication
+  std::vector<MVCCStore::Write> logged = commit->writes;
+  node.persist("txn", encode(logged), [this, commit, response = std::move(response)] {
+    publish(*commit);
+    node.send(response);
+  });
+  return Message();
+}
+
+
+auto Txn::handle_replicate(const Message& msg) -> Message
+{
+  std::optional<std::vector<MVCCStore::Write>> writes = decode(msg.body);
+  if (!writes.has_value())
+    return msg.create_error(ERR_MALFORMED_REQUEST, "txn_replicate without matching 'keys', 'values' and 'stamps'");
+  // later local writes have to beat everything seen from the peer
+  if (!writes->empty())
+    Snowflake::witness(writes->back().stamp);
+  const uint64_t ts = store.commit(store.latest(), writes.value(), MVCCStore::READ_COMMITTED).value();
+  node.persist("txn", encode(writes.value()), [this, ts, response = msg.create_response()] {
+    store.publish(ts);
+    node.send(response);
+  });
+  return Message();
+}
+
+
+void Txn::replay(const json& record)
+{
+  std::optional<std::vector<MVCCStore::Write>> writes = decode(record);
+  if (!writes.has_value() || writes->empty())
+    return;
+  Snowflake::witness(writes->back().stamp);
+  store.publish(store.commit(store.latest(), writes.value(), MVCCStore::READ_COMMITTED).value());
+}
+
+
+auto Txn::execute(const json& ops, Commit* commit) -> std::optional<json>
+{
+  Commit attempted;
+  for (int attempts = 0; attempts < config.max_attempts; ++attempts) {
+    attempted.writes.clear();
+    std::optional<json> completed = attempt(ops, attempted);
+    if (!completed.has_value())
+      continue;
+    if (nullptr == commit)
+      publish(attempted);
+    else
+      *commit = std::move(attempted);
+    return completed;
+  }
+  return std::nullopt;
+}
+
+
+void Txn::publish(const Commit& commit)
+{
+  if (commit.ts == 0)
+    return;
+  store.publish(commit.ts);
+  replicate(commit.writes);
+}
+
+
+auto Txn::attempt(const json& ops, Commit& commit) -> std::optional<json>
+{
+  std::vector<MVCCStore::Write>& writes = commit.writes;
+  const uint64_t snapshot = store.begin();
+  json completed = json::array();
+  // key -> index into `writes`, a key written twice keeps only its last value
+  std::unordered_map<std::string, std::size_t> written;
+
+  for (const json& op : ops) {
+    std::string key = op[1].dump();
+    if (op[0] == "w") {
+      auto [it, inserted] = written.try_emplace(key, writes.size());
+      if (inserted)
+        writes.push_back({ std::move(key), op[2] });
+      else
+        writes[it->second].value = op[2];
+      completed.push_back(op);
+      continue;
+    }
+    auto own = written.find(key);
+    json value = own != written.end()
+      ? writes[own->second].value
+      : store.read(key, config.isolation == MVCCStore::SNAPSHOT ? snapshot : store.latest());
+    completed.push_back(json::array({ "r", op[1], std::move(value) }));
+  }
+
+  // read-only transactions never reach the commit path, they cannot conflict with anything
+  std::optional<uint64_t> ts = 0;
+  if (!writes.empty()) {
+    const Snowflake stamp = Snowflake::generate_ordered(node_index());
+    for (MVCCStore::Write& write : writes)
+      write.stamp = stamp;
+    ts = store.commit(snapshot, writes, config.isolation);
+  }
+  store.end(snapshot);
+  if (!ts.has_value())
+    return std::nullopt;
+  commit.ts = ts.value();
+  return completed;
+}
+
+
+auto Txn::node_index() -> uint16_t
+{
+  std::call_once(indexed, [this] {
+    const std::vector<std::string>& ids = node.node_ids();
+    auto found = std::find(ids.begin(), ids.end(), node.node_id());
+    index = found == ids.end() ? 0 : static_cast<uint16_t>(found - ids.begin());
+  });
+  return index;
+}
+
+
+auto Txn::encode(std::vector<MVCCStore::Write>& batch) -> json
+{
+  std::sort(batch.begin(), batch.end(), [](const MVCCStore::Write& lhs, const MVCCStore::Write& rhs) {
+    return lhs.stamp < rhs.stamp;
+  });
+  json keys = json::array(), values = json::array(), stamps = json::array();
+  uint64_t previous = 0;
+  for (MVCCStore::Write& write : batch) {
+    const uint64_t stamp = write.stamp.as_json().get<uint64_t>();
+    keys.push_back(std::move(write.key));
+    values.push_back(std::move(write.value));
+    stamps.push_back(stamp - previous);
+    previous = stamp;
+  }
+  return { { "keys", std::move(keys) }, { "values", std::move(values) }, { "stamps", std::move(stamps) } };
+}
+
+
+auto Txn::decode(const json& body) -> std::optional<std::vector<MVCCStore::Write>>
+{
+  for (const char* field : { "keys", "values", "stamps" }) {
+    if (!body.contains(field) || !body[field].is_array())
+      return std::nullopt;
+  }
+  const json& keys = body["keys"];
+  const json& values = body["values"];
+  const json& stamps = body["stamps"];
+  if (keys.size() != values.size() || keys.size() != stamps.size())
+    return std::nullopt;
+
+  std::vector<MVCCStore::Write> writes;
+  writes.reserve(keys.size());
+  uint64_t stamp = 0;
+  for (std::size_t idx = 0; idx < keys.size(); ++idx) {
+    if (!keys[idx].is_string() || !stamps[idx].is_number_unsigned())
+      return std::nullopt;
+    stamp += stamps[idx].get<uint64_t>();
+    std::optional<Snowflake> parsed = Snowflake::from_json(stamp);
+    if (!parsed.has_value())
+      return std::nullopt;
+    writes.push_back({ keys[idx].get<std::string>(), values[idx], parsed.value() });
+  }
+  return writes;
+}
+
+
+void Txn::coalesce(Outbox& outbox, MVCCStore::Write&& write)
+{
+  auto [it, inserted] = outbox.pending.try_emplace(write.key, write);
+  if (!inserted && it->second.stamp < write.stamp)
+    it->second = std::move(write);
+}
+
+
+void Txn::replicate(const std::vector<MVCCStore::Write>& writes)
+{
+  std::unique_lock lock(mutex_outboxes);
+  for (const std::string& peer : node.node_ids()) {
+    if (peer == node.node_id())
+      continue;
+    Outbox& outbox = outboxes[peer];
+    for (const MVCCStore::Write& write : writes)
+      coalesce(outbox, MVCCStore::Write(write));
+  }
+  if (!outboxes.empty())
+    schedule_flush();
+}
+
+
+void Txn::schedule_flush()
+{
+  if (flush_scheduled)
+    return;
+  flush_scheduled = true;
+  node.schedule(config.replicate_interval, [this] { flush(); });
+}
+
+
+void Txn::flush()
+{
+  std::unique_lock lock(mutex_outboxes);
+  flush_scheduled = false;
+  for (auto& [peer, outbox] : outboxes)
+    flush_to(peer, outbox);
+}
+
+
+void Txn::flush_to(const std::string& peer, Outbox& outbox)
+{
+  if (outbox.in_flight || outbox.pending.empty())
+    return;
+  auto batch = std::make_shared<std::vector<MVCCStore::Write>>();
+  batch->reserve(std::min(outbox.pending.size(), config.max_batch));
+  while (!outbox.pending.empty() && batch->size() < config.max_batch) {
+    batch->push_back(std::move(outbox.pending.begin()->second));
+    outbox.pending.erase(outbox.pending.begin());
+  }
+  outbox.in_flight = true;
+
+  // encoding sorts and moves out of the batch, keep a copy to requeue on failure
+  std::vector<MVCCStore::Write> encoded = *batch;
+  Message request(TXN_REPLICATE_REQ, Snowflake::generate_64(), node.node_id(), peer);
+  request.body.update(encode(encoded));
+  node.rpc(request, [this, peer, batch](const Message& reply) {
+    std::unique_lock lock(mutex_outboxes);
+    Outbox& outbox = outboxes[peer];
+    outbox.in_flight = false;
+    if (reply.type != TXN_REPLICATE_RES) {
+      for (MVCCStore::Write& write : *batch)
+        coalesce(outbox, std::move(write));
+    }
+    if (!outbox.pending.empty())
+      schedule_flush();
+  }, config.replicate_timeout);
+}
@@ -0,0 +1,90 @@
+#ifndef TXN_TXN_HEADER
+#define TXN_TXN_HEADER
+#include "mvcc_store.h"
+#include "common/message.h"
+#include "common/node.h"
+#include "ext/nlohmann/json.hpp"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// handler for maelstrom's txn-rw-register workload, transactions of ["r", k, null] / ["w", k, v] micro-ops.
+// every transaction runs against the node's multi-version store: reads see the transaction's own writes first,
+// then the store at the transaction's snapshot (SNAPSHOT) or at the latest commit (READ_COMMITTED).
+// writes are buffered and installed at commit. a transaction refused by first-committer-wins is re-run
+// up to `max_attempts` times before the client gets a txn-conflict error.
+// transactions are answered from the local store alone, committed writes reach the other nodes asynchronously:
+// each peer has an outbox coalescing the newest write per key, flushed every `replicate_interval` as one
+// txn_replicate batch with at most one batch in flight. a batch that is not acknowledged goes back into the
+// outbox, so a partitioned peer catches up with the latest value of every key once it is reachable again.
+// local commits and applied batches are persisted under the "txn" stream before they become visible to other
+// transactions, are replicated or acknowledged. replay reapplies them through the same last-writer-wins rule,
+// so their order does not matter.
+// checkpoints dump the newest value per key, a restarted node serves keys nobody wrote since from the mapping.
+class Txn
+{
+  using json = nlohmann::json;
+public:
+  struct Config {
+    MVCCStore::Isolation      isolation           = MVCCStore::SNAPSHOT;
+    int                       max_attempts        = 4;
+    std::chrono::milliseconds replicate_interval  = std::chrono::milliseconds(10);
+    std::chrono::milliseconds replicate_timeout   = std::chrono::milliseconds(500);
+    std::size_t               max_batch           = 1024;
+  };
+
+  Txn(Node& node, Config config);
+  explicit Txn(Node& node) : Txn(node, Config()) {}
+
+  // what a transaction committed, `ts` is 0 for a read-only one
+  struct Commit {
+    std::vector<MVCCStore::Write> writes;
+    uint64_t                      ts = 0;
+  };
+  // runs a list of micro-ops, the completed list on commit, nullopt when every attempt conflicted.
+  // without `commit` the writes are published right away, with it they stay invisible to other transactions
+  // and unreplicated until the caller passes it to `publish`, e.g. once it is durable
+  auto execute(const json& ops, Commit* commit = nullptr) -> std::optional<json>;
+  void publish(const Commit& commit);
+
+private:
+  auto handle_txn(const Message& msg) -> Message;
+  auto handle_replicate(const Message& msg) -> Message;
+  void replay(const json& record);
+
+  auto attempt(const json& ops, Commit& commit) -> std::optional<json>;
+  auto node_index() -> uint16_t;
+
+  // batches are sorted by stamp and sent column-wise, stamps as deltas to their predecessor
+  static auto encode(std::vector<MVCCStore::Write>& batch) -> json;
+  static auto decode(const json& body) -> std::optional<std::vector<MVCCStore::Write>>;
+
+private:
+  struct Outbox {
+    std::unordered_map<std::string, MVCCStore::Write> pending;
+    bool                                              in_flight = false;
+  };
+  // keeps the newest write per key, a write that lost to a newer one is not worth sending anymore
+  static void coalesce(Outbox& outbox, MVCCStore::Write&& write);
+
+  void replicate(const std::vector<MVCCStore::Write>& writes);
+  void schedule_flush();
+  void flush();
+  void flush_to(const std::string& peer, Outbox& outbox);
+
+  Node&                                   node;
+  const Config                            config;
+  MVCCStore                               store;
+  std::once_flag                          indexed;
+  uint16_t                                index;
+
+  std::mutex                              mutex_outboxes;
+  std::unordered_map<std::string, Outbox> outboxes;
+  bool                                    flush_scheduled;
+};
+
+#endif
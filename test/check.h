@@ -0,0 +1,16 @@
+#ifndef TEST_CHECK_HEADER
+#define TEST_CHECK_HEADER
+#include <cstdlib>
+#include <iostream>
+
+// every test/*.cpp is its own binary, `make test` runs them all. a failed check names itself and exits non-zero,
+// built without exceptions there is nothing to unwind anyway
+#define CHECK(condition)                                                                      \
+  do {                                                                                        \
+    if (!(condition)) {                                                                       \
+      std::clog << "[❌][TST] " << __FILE__ << ':' << __LINE__ << ": " << #condition << '\n'; \
+      std::exit(1);                                                                           \
+    }                                                                                         \
+  } while (false)
+
+#endif
@@ -0,0 +1,51 @@
+#include "check.h"
+#include "common/message.h"
+#include "common/node.h"
+#include "common/snowflake.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+// shed-oldest on a single lane whose backlog starts with a timer of the lane: the request waiting behind the
+// timer is the one to go, the timer still runs. driven from one thread, the way the simulator drives a node
+
+namespace {
+  auto echo(int id) -> Message
+  {
+    Message msg(ECHO_REQ, Snowflake::generate_64(), "c1", "n1");
+    msg.body["echo"] = id;
+    return msg;
+  }
+}
+
+
+int main()
+{
+  Node node(0);
+  node.enable_lanes(1);
+  node.set_queue_limit(1, Node::SHED_OLDEST);
+  node.init({ "n1" }, 0);
+
+  std::vector<int> echoed;
+  bool fired = false;
+  node.register_handler(ECHO_REQ, [&](const Message& msg) -> Message {
+    const int id = msg.body["echo"].get<int>();
+    echoed.push_back(id);
+    if (id == 1) {
+      // while the first echo holds the lane: a timer of the lane queues behind it, then two more requests
+      // arrive, the second of which finds the queue full
+      node.schedule(std::chrono::microseconds::zero(), [&fired] { fired = true; });
+      node.fire_timers();
+      node.deliver(echo(2));
+      node.deliver(echo(3));
+    }
+    return Message();
+  });
+
+  node.deliver(echo(1));
+  node.run_pending();
+
+  CHECK(fired);
+  CHECK((echoed == std::vector<int>{ 1, 3 }));
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include "check.h"
+#include "common/snapshot_file.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+// writes a snapshot spanning many blocks, opens it and looks every key up, then checks that snapshots
+// whose footer was tampered with are turned away instead of taken at their word
+
+namespace {
+  constexpr int entry_count = 5000;
+
+  auto key_of(int idx) -> std::string
+  {
+    char key[16];
+    std::snprintf(key, sizeof(key), "key-%06d", idx);
+    return key;
+  }
+
+  auto value_of(int idx) -> std::string
+  {
+    return std::string(idx % 64, 'v') + std::to_string(idx);
+  }
+
+  auto read_file(const std::string& path) -> std::string
+  {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  }
+
+  // flips the topmost bit of the footer's block count, which the index crc does not cover
+  void corrupt_block_count(const std::string& from, const std::string& to)
+  {
+    std::string bytes = read_file(from);
+    bytes[bytes.size() - 40 + 16 + 7] ^= 0x80;
+    std::ofstream(to, std::ios::binary) << bytes;
+  }
+
+  // moves the index offset far past the end of the file and grows the index size by as much the other way, so
+  // that the two still add up to the footer's position once the sum wraps around
+  void corrupt_index_bounds(const std::string& from, const std::string& to)
+  {
+    std::string bytes = read_file(from);
+    char* footer = bytes.data() + bytes.size() - 40;
+    uint64_t index_offset, index_size;
+    std::memcpy(&index_offset, footer, sizeof(index_offset));
+    std::memcpy(&index_size, footer + 8, sizeof(index_size));
+    const uint64_t shift = uint64_t(1) << 63;
+    index_offset += shift;
+    index_size -= shift;
+    std::memcpy(footer, &index_offset, sizeof(index_offset));
+    std::memcpy(footer + 8, &index_size, sizeof(index_size));
+    std::ofstream(to, std::ios::binary) << bytes;
+  }
+}
+
+
+int main()
+{
+  char dir[] = "/tmp/snapshot_file.XXXXXX";
+  CHECK(nullptr != ::mkdtemp(dir));
+  const std::string path = std::string(dir).append("/round_trip.snap");
+  const std::string damaged = std::string(dir).append("/damaged.snap");
+
+  {
+    SnapshotWriter writer;
+    CHECK(writer.open(path));
+    for (int idx = 0; idx < entry_count; ++idx)
+      CHECK(writer.add(key_of(idx), value_of(idx)));
+    // out of order, the writer refuses and the file is never finished
+    SnapshotWriter rejected;
+    CHECK(rejected.open(damaged));
+    CHECK(rejected.add("b", "1"));
+    CHECK(!rejected.add("a", "2"));
+    CHECK(!rejected.finish());
+    CHECK(writer.finish());
+  }
+
+  std::unique_ptr<SnapshotFile> snapshot = SnapshotFile::open(path);
+  CHECK(nullptr != snapshot);
+  CHECK(snapshot->size() == entry_count);
+  for (int idx = 0; idx < entry_count; ++idx) {
+    std::optional<std::string_view> found = snapshot->find(key_of(idx));
+    CHECK(found.has_value());
+    CHECK(found.value() == value_of(idx));
+  }
+  CHECK(!snapshot->find("key-").has_value());
+  CHECK(!snapshot->find(key_of(entry_count)).has_value());
+  CHECK(!snapshot->find("a").has_value());
+
+  int visited = 0;
+  snapshot->for_each([&](std::string_view key, std::string_view value) {
+    CHECK(key == key_of(visited));
+    CHECK(value == value_of(visited));
+    ++visited;
+  });
+  CHECK(visited == entry_count);
+
+  corrupt_block_count(path, damaged);
+  CHECK(nullptr == SnapshotFile::open(damaged));
+  corrupt_index_bounds(path, damaged);
+  CHECK(nullptr == SnapshotFile::open(damaged));
+  CHECK(nullptr == SnapshotFile::open(std::string(dir).append("/missing.snap")));
+
+  std::remove(path.c_str());
+  std::remove(damaged.c_str());
+  ::rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include "check.h"
+#include "common/spsc_ring.h"
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// empty and full edges, wraparound of the indices past the slot count, then one producer and one consumer
+// thread passing a sequence through a small ring, which has to arrive complete and in order
+
+namespace {
+  constexpr uint64_t streamed = 1'000'000;
+}
+
+
+int main()
+{
+  SpscRing<int> ring(3);
+  // rounded up to a power of two
+  CHECK(ring.capacity() == 4);
+  CHECK(ring.empty());
+  int out = -1;
+  CHECK(!ring.try_pop(out));
+  CHECK(out == -1);
+
+  for (int value = 0; value < 4; ++value)
+    CHECK(ring.try_push(int(value)));
+  CHECK(!ring.try_push(4));
+  CHECK(!ring.empty());
+  for (int value = 0; value < 4; ++value) {
+    CHECK(ring.try_pop(out));
+    CHECK(out == value);
+  }
+  CHECK(!ring.try_pop(out));
+  CHECK(ring.empty());
+
+  // head and tail run many times around the slots, interleaving pushes and pops at every offset
+  int next_in = 0, next_out = 0;
+  for (int round = 0; round < 1000; ++round) {
+    const int burst = round % 4 + 1;
+    for (int idx = 0; idx < burst; ++idx)
+      CHECK(ring.try_push(int(next_in++)));
+    for (int idx = 0; idx < burst; ++idx) {
+      CHECK(ring.try_pop(out));
+      CHECK(out == next_out++);
+    }
+    CHECK(ring.empty());
+  }
+
+  // moved-only values survive the trip
+  SpscRing<std::unique_ptr<int>> owning(2);
+  CHECK(owning.try_push(std::make_unique<int>(7)));
+  std::unique_ptr<int> taken;
+  CHECK(owning.try_pop(taken));
+  CHECK(nullptr != taken && *taken == 7);
+
+  SpscRing<uint64_t> shared(64);
+  std::thread producer([&shared] {
+    for (uint64_t value = 0; value < streamed; ++value) {
+      while (!shared.try_push(uint64_t(value)))
+        std::this_thread::yield();
+    }
+  });
+  uint64_t expected = 0;
+  while (expected < streamed) {
+    uint64_t value;
+    if (!shared.try_pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    CHECK(value == expected);
+    ++expected;
+  }
+  producer.join();
+  CHECK(shared.empty());
+  return 0;
+}